@@ -100,6 +100,58 @@ private Q_SLOTS:
         proc2.kill();
         m_danglingPids.removeAll(pid2);
     }
+
+    void testStandby()
+    {
+        // The previous test's processes may still be dropping off the bus.
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        QProcess proc1;
+        proc1.setProgram(QFINDTESTDATA("kdbussimpleservice"));
+        proc1.setProcessChannelMode(QProcess::ForwardedChannels);
+        proc1.start();
+        QVERIFY(proc1.waitForStarted());
+        m_danglingPids << proc1.processId();
+
+        qint64 pid1 = proc1.processId();
+        QVERIFY(pid1 >= 0);
+        bool proc1Registered = QTest::qWaitFor(
+            [&]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == pid1;
+            },
+            8000);
+        QVERIFY(proc1Registered);
+
+        // The standby must neither exit nor take the name while proc1 is alive.
+        QProcess proc2;
+        proc2.setProgram(QFINDTESTDATA("kdbussimpleservice"));
+        proc2.setArguments({QStringLiteral("--standby")});
+        proc2.setProcessChannelMode(QProcess::ForwardedChannels);
+        proc2.start();
+        QVERIFY(proc2.waitForStarted());
+        m_danglingPids << proc2.processId();
+        qint64 pid2 = proc2.processId();
+        QVERIFY(pid2 >= 0);
+
+        QVERIFY(!proc2.waitForFinished(2000));
+        QCOMPARE(QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value(), pid1);
+
+        // Kill the primary, the standby should own the name right away.
+        proc1.kill();
+        QVERIFY(proc1.waitForFinished());
+        m_danglingPids.removeAll(pid1);
+
+        bool proc2Registered = QTest::qWaitFor(
+            [&]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == pid2;
+            },
+            2000);
+        QVERIFY(proc2Registered);
+
+        proc2.kill();
+        QVERIFY(proc2.waitForFinished());
+        m_danglingPids.removeAll(pid2);
+    }
 };
 
 QTEST_MAIN(TestObject)
@@ -0,0 +1,162 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusVariant>
+#include <QDBusVirtualObject>
+#include <QTest>
+
+#include <kdbusservice.h>
+
+#include <memory>
+
+// Keeps the last call it received
+class MessageCapture : public QDBusVirtualObject
+{
+    Q_OBJECT
+
+public:
+    QString introspect(const QString &path) const override
+    {
+        Q_UNUSED(path);
+        return QString();
+    }
+
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override
+    {
+        Q_UNUSED(connection);
+        captured = message;
+        return true;
+    }
+
+    QDBusMessage captured;
+};
+
+// Measures the cost of dispatching activation calls, without the round trip
+// through the bus. Each call is sent through the bus once, so that the message
+// handed to the dispatcher carries its arguments as received, and is then
+// dispatched repeatedly. Sending with QDBusConnection::send() means no reply
+// is expected, so the dispatcher sends none.
+class KDBusServiceDispatchBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QCoreApplication::setOrganizationDomain(QStringLiteral("kde.org"));
+        m_service = std::make_unique<KDBusService>(KDBusService::Multiple | KDBusService::NoExitOnFailure);
+        QVERIFY(m_service->isRegistered());
+
+        connect(m_service.get(), &KDBusService::activateRequested, this, [this]() {
+            ++m_activations;
+        });
+        connect(m_service.get(), &KDBusService::activateActionRequested, this, [this]() {
+            ++m_activations;
+        });
+        connect(m_service.get(), &KDBusService::openRequested, this, [this]() {
+            ++m_activations;
+        });
+
+        // The object exported at the service's object path
+        m_dispatcher = m_service->findChild<QDBusVirtualObject *>();
+        QVERIFY(m_dispatcher);
+
+        m_connection = std::make_unique<QDBusConnection>(QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("dispatchbenchmark")));
+        QVERIFY(m_connection->isConnected());
+        QVERIFY(m_connection->registerVirtualObject(QStringLiteral("/capture"), &m_capture));
+    }
+
+    void cleanupTestCase()
+    {
+        m_connection->unregisterObject(QStringLiteral("/capture"));
+        m_connection.reset();
+        QDBusConnection::disconnectFromBus(QStringLiteral("dispatchbenchmark"));
+        m_service.reset();
+    }
+
+    void benchmarkActivate()
+    {
+        const QDBusMessage message = capture(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {platformData()});
+        QBENCHMARK {
+            dispatch(message);
+        }
+    }
+
+    void benchmarkOpen()
+    {
+        const QStringList uris{QStringLiteral("file:///tmp/a.txt"), QStringLiteral("file:///tmp/b.txt")};
+        const QDBusMessage message = capture(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Open"), {uris, platformData()});
+        QBENCHMARK {
+            dispatch(message);
+        }
+    }
+
+    void benchmarkActivateAction()
+    {
+        const QVariantList parameter{QVariant::fromValue(QDBusVariant(42))};
+        const QDBusMessage message =
+            capture(QStringLiteral("org.freedesktop.Application"), QStringLiteral("ActivateAction"), {QStringLiteral("action"), parameter, platformData()});
+        QBENCHMARK {
+            dispatch(message);
+        }
+    }
+
+    void benchmarkCommandLine()
+    {
+        const QStringList arguments{QStringLiteral("app"), QStringLiteral("--option")};
+        const QDBusMessage message =
+            capture(QStringLiteral("org.kde.KDBusService"), QStringLiteral("CommandLine"), {arguments, QStringLiteral("/tmp"), platformData()});
+        QBENCHMARK {
+            dispatch(message);
+        }
+    }
+
+private:
+    static QVariantMap platformData()
+    {
+        return {{QStringLiteral("activation-token"), QByteArray("token")}, {QStringLiteral("desktop-startup-id"), QStringLiteral("id")}};
+    }
+
+    // Returns the call as it arrives from the bus
+    QDBusMessage capture(const QString &interface, const QString &method, const QVariantList &arguments)
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(m_connection->baseService(), QStringLiteral("/capture"), interface, method);
+        message.setArguments(arguments);
+
+        m_capture.captured = QDBusMessage();
+        [&]() {
+            QVERIFY(QDBusConnection::sessionBus().send(message));
+            QTRY_COMPARE(m_capture.captured.member(), method);
+            QVERIFY(!m_capture.captured.isReplyRequired());
+        }();
+        return m_capture.captured;
+    }
+
+    // Hands the message to the dispatcher and waits until it has been handled
+    void dispatch(const QDBusMessage &message)
+    {
+        const int activations = m_activations;
+        QVERIFY(m_dispatcher->handleMessage(message, QDBusConnection::sessionBus()));
+        while (m_service->pendingActivations(KDBusService::InteractivePriority) + m_service->pendingActivations(KDBusService::BulkPriority) > 0) {
+            QCoreApplication::processEvents();
+        }
+        QCOMPARE(m_activations, activations + 1);
+    }
+
+    std::unique_ptr<KDBusService> m_service;
+    std::unique_ptr<QDBusConnection> m_connection;
+    QDBusVirtualObject *m_dispatcher = nullptr;
+    MessageCapture m_capture;
+    int m_activations = 0;
+};
+
+QTEST_MAIN(KDBusServiceDispatchBenchmark)
+
+#include "kdbusservicedispatchbenchmark.moc"
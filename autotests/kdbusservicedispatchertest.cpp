@@ -0,0 +1,331 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusMetaType>
+#include <QDBusPendingCall>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QDeadlineTimer>
+#include <QTest>
+#include <QUrl>
+
+#include <kdbusservice.h>
+
+#include "kdbusserviceaction_p.h"
+
+#include <chrono>
+#include <memory>
+
+// Calls are made from a second connection, as calls to ourselves through the
+// same connection are handled right away rather than queued. They go to the unique name
+// of the service's connection, which stays when the service name is released.
+class KDBusServiceDispatcherTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        QCoreApplication::setOrganizationDomain(QStringLiteral("kde.org"));
+        m_service = std::make_unique<KDBusService>(KDBusService::Multiple | KDBusService::NoExitOnFailure);
+        QVERIFY(m_service->isRegistered());
+
+        // Built from the name without the instance suffix Multiple adds to it
+        m_objectPath = QLatin1String("/org/kde/") + QCoreApplication::applicationName();
+        m_objectPath.replace(QLatin1Char('-'), QLatin1Char('_'));
+
+        m_connection = std::make_unique<QDBusConnection>(QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("dispatchertest")));
+        QVERIFY(m_connection->isConnected());
+    }
+
+    void cleanupTestCase()
+    {
+        m_connection.reset();
+        QDBusConnection::disconnectFromBus(QStringLiteral("dispatchertest"));
+        m_service.reset();
+    }
+
+    void testDispatch()
+    {
+        QObject context;
+        QStringList events;
+        connect(m_service.get(), &KDBusService::activateRequested, &context, [this, &events](const QStringList &arguments, const QString &workingDirectory) {
+            events << QStringLiteral("activate %1 in %2").arg(arguments.join(QLatin1Char(' ')), workingDirectory);
+            m_service->setExitValue(arguments.size());
+        });
+        connect(m_service.get(), &KDBusService::openRequested, &context, [&events](const QList<QUrl> &uris) {
+            events << QStringLiteral("open %1").arg(uris.value(0).toString());
+        });
+        connect(m_service.get(), &KDBusService::activateActionRequested, &context, [&events](const QString &actionName, const QVariant &parameter) {
+            events << QStringLiteral("action %1 %2").arg(actionName, parameter.toString());
+        });
+
+        const QDBusPendingCall open = m_connection->asyncCall(
+            call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Open"), {QStringList{QStringLiteral("file:///tmp/a.txt")}, QVariantMap()}));
+        const QVariantList parameter{QVariant::fromValue(QDBusVariant(42))};
+        const QDBusPendingCall action = m_connection->asyncCall(
+            call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("ActivateAction"), {QStringLiteral("quit"), parameter, QVariantMap()}));
+        const QDBusPendingReply<int> commandLine = m_connection->asyncCall(call(QStringLiteral("org.kde.KDBusService"),
+                                                                                QStringLiteral("CommandLine"),
+                                                                                {QStringList{QStringLiteral("app"), QStringLiteral("-x")}, QStringLiteral("/tmp"), QVariantMap()}));
+        QTRY_VERIFY(open.isFinished() && action.isFinished() && commandLine.isFinished());
+        QVERIFY(!open.isError());
+        QVERIFY(!action.isError());
+        QVERIFY(!commandLine.isError());
+        QCOMPARE(commandLine.value(), 2);
+
+        QVERIFY(events.contains(QStringLiteral("open file:///tmp/a.txt")));
+        QVERIFY(events.contains(QStringLiteral("action quit 42")));
+        QVERIFY(events.contains(QStringLiteral("activate app -x in /tmp")));
+        QCOMPARE(events.size(), 3);
+
+        // Arguments of the wrong type are refused before anything is queued
+        const QDBusPendingCall invalid =
+            m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {QStringLiteral("garbage")}));
+        QTRY_VERIFY(invalid.isFinished());
+        QCOMPARE(invalid.error().type(), QDBusError::InvalidSignature);
+        QCOMPARE(events.size(), 3);
+    }
+
+    void testActivateActions()
+    {
+        qDBusRegisterMetaType<KDBusServiceAction>();
+        qDBusRegisterMetaType<KDBusServiceActionList>();
+
+        QObject context;
+        QStringList handled;
+        connect(m_service.get(), &KDBusService::activateActionRequested, &context, [&handled](const QString &actionName, const QVariant &parameter) {
+            handled << actionName + QLatin1Char(' ') + (parameter.isValid() ? parameter.toString() : QStringLiteral("none"));
+        });
+
+        // The parameter of an action is wrapped in an array, more than one value in it is not a parameter
+        const KDBusServiceActionList actions{
+            {QStringLiteral("first"), {}},
+            {QStringLiteral("second"), {7}},
+            {QStringLiteral("third"), {1, 2}},
+            {QStringLiteral("fourth"), {QStringLiteral("x")}},
+        };
+        const QDBusPendingCall reply = m_connection->asyncCall(
+            call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("ActivateActions"), {QVariant::fromValue(actions), QVariantMap()}));
+        QTRY_VERIFY(reply.isFinished());
+        QVERIFY(!reply.isError());
+        const QStringList expected{
+            QStringLiteral("first none"),
+            QStringLiteral("second 7"),
+            QStringLiteral("third none"),
+            QStringLiteral("fourth x"),
+        };
+        QCOMPARE(handled, expected);
+
+        // Elements that are not (sav) are refused as a whole
+        const QDBusPendingCall invalid = m_connection->asyncCall(
+            call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("ActivateActions"), {QStringList{QStringLiteral("first")}, QVariantMap()}));
+        QTRY_VERIFY(invalid.isFinished());
+        QCOMPARE(invalid.error().type(), QDBusError::InvalidSignature);
+        QCOMPARE(handled.size(), 4);
+    }
+
+    void testRateLimit()
+    {
+        m_service->setActivationRateLimit(2, 3);
+
+        // Sent faster than any token comes back, only the burst gets through
+        QList<QDBusPendingCall> replies;
+        for (int i = 0; i < 5; ++i) {
+            replies << m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {QVariantMap()}));
+        }
+        int rejected = 0;
+        for (const QDBusPendingCall &reply : std::as_const(replies)) {
+            QTRY_VERIFY(reply.isFinished());
+            if (reply.isError()) {
+                QCOMPARE(reply.error().type(), QDBusError::LimitsExceeded);
+                ++rejected;
+            }
+        }
+        QCOMPARE(rejected, 2);
+
+        // A token comes back every 500 ms
+        QTest::qWait(600);
+        const QDBusPendingCall refilled = m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {QVariantMap()}));
+        QTRY_VERIFY(refilled.isFinished());
+        QVERIFY(!refilled.isError());
+
+        m_service->setActivationRateLimit(0, 1);
+    }
+
+    void testPriorities()
+    {
+        QObject context;
+        QStringList handled;
+        connect(m_service.get(), &KDBusService::openRequested, &context, [&handled](const QList<QUrl> &urls) {
+            handled << urls.value(0).fileName();
+        });
+        connect(m_service.get(), &KDBusService::activateActionRequested, &context, [&handled](const QString &actionName) {
+            handled << actionName;
+        });
+
+        QList<QDBusPendingCall> replies;
+        for (int i = 1; i <= 3; ++i) {
+            const QStringList uris{QStringLiteral("file:///tmp/open%1").arg(i)};
+            replies << m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Open"), {uris, QVariantMap()}));
+        }
+        for (int i = 1; i <= 6; ++i) {
+            const QString actionName = QStringLiteral("action%1").arg(i);
+            replies << m_connection->asyncCall(
+                call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("ActivateAction"), {actionName, QVariantList(), QVariantMap()}));
+        }
+
+        // Deliver the calls without running the event loop, which would start handling them
+        auto pending = [this]() {
+            return m_service->pendingActivations(KDBusService::InteractivePriority) + m_service->pendingActivations(KDBusService::BulkPriority);
+        };
+        QDeadlineTimer deadline(5000);
+        while (pending() < 9 && !deadline.hasExpired()) {
+            QTest::qSleep(10);
+            QCoreApplication::sendPostedEvents();
+        }
+        QCOMPARE(m_service->pendingActivations(KDBusService::BulkPriority), 3);
+        QCOMPARE(m_service->pendingActivations(KDBusService::InteractivePriority), 6);
+
+        for (const QDBusPendingCall &reply : std::as_const(replies)) {
+            QTRY_VERIFY(reply.isFinished());
+            QVERIFY(!reply.isError());
+        }
+        QCOMPARE(pending(), 0);
+
+        // The actions overtake the queued Open calls, but one of those gets its turn after four actions in a row
+        const QStringList expected{
+            QStringLiteral("action1"),
+            QStringLiteral("action2"),
+            QStringLiteral("action3"),
+            QStringLiteral("action4"),
+            QStringLiteral("open1"),
+            QStringLiteral("action5"),
+            QStringLiteral("action6"),
+            QStringLiteral("open2"),
+            QStringLiteral("open3"),
+        };
+        QCOMPARE(handled, expected);
+    }
+
+    void testLocalCall()
+    {
+        int activated = 0;
+        QObject context;
+        connect(m_service.get(), &KDBusService::activateRequested, &context, [&activated]() {
+            ++activated;
+        });
+
+        // A blocking call to ourselves cannot wait for the event loop to handle it
+        const QDBusMessage reply =
+            QDBusConnection::sessionBus().call(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {QVariantMap()}));
+        QCOMPARE(reply.type(), QDBusMessage::ReplyMessage);
+        QCOMPARE(activated, 1);
+    }
+
+    void testLaunchLatency()
+    {
+        QList<std::pair<qint64, qint64>> measured;
+        QObject context;
+        connect(m_service.get(), &KDBusService::launchLatencyMeasured, &context, [&measured](qint64 launcherPid, qint64 latencyUsec) {
+            measured.append({launcherPid, latencyUsec});
+        });
+
+        // The same clock KDBusService reads, shared by all processes
+        const qint64 now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        const QVariantMap launch{{QStringLiteral("kde-launch-timestamp"), now}, {QStringLiteral("kde-launch-pid"), qint64(1234)}};
+        const QDBusPendingCall measuredCall = m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {launch}));
+        QTRY_VERIFY(measuredCall.isFinished());
+        QVERIFY(!measuredCall.isError());
+        QCOMPARE(measured.size(), 1);
+        QCOMPARE(measured.first().first, qint64(1234));
+        QVERIFY(measured.first().second >= 0);
+
+        // Launches without a usable timestamp are not measured
+        const QList<QVariantMap> unmeasured{
+            QVariantMap{{QStringLiteral("kde-launch-pid"), qint64(1234)}},
+            QVariantMap{{QStringLiteral("kde-launch-timestamp"), QStringLiteral("garbage")}, {QStringLiteral("kde-launch-pid"), qint64(1234)}},
+            QVariantMap{{QStringLiteral("kde-launch-timestamp"), now + qint64(3600) * 1000000000}, {QStringLiteral("kde-launch-pid"), qint64(1234)}},
+        };
+        for (const QVariantMap &platformData : unmeasured) {
+            const QDBusPendingCall reply = m_connection->asyncCall(call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {platformData}));
+            QTRY_VERIFY(reply.isFinished());
+            QVERIFY(!reply.isError());
+        }
+        QCOMPARE(measured.size(), 1);
+    }
+
+    // Must run last, the service is gone afterwards
+    void testHandOver()
+    {
+        QStringList events;
+        connect(m_service.get(), &KDBusService::openRequested, this, [&events]() {
+            events << QStringLiteral("open");
+        });
+        connect(m_service.get(), &KDBusService::handOverRequested, this, [this, &events]() {
+            events << QStringLiteral("handover");
+            m_service->setHandOverState("state");
+        });
+
+        // Only the process about to replace us, which waits in the queue for our name, gets the state
+        const QDBusPendingCall refused = m_connection->asyncCall(call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("HandOver"), {}));
+        QTRY_VERIFY(refused.isFinished());
+        QCOMPARE(refused.error().type(), QDBusError::AccessDenied);
+        QVERIFY(events.isEmpty());
+
+        const QString serviceName = m_service->serviceName();
+        QCOMPARE(m_connection->interface()->registerService(serviceName, QDBusConnectionInterface::QueueService).value(),
+                 QDBusConnectionInterface::ServiceQueued);
+
+        // Queued before the hand-over, so it is handled before the state is taken
+        const QDBusPendingCall open = m_connection->asyncCall(
+            call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Open"), {QStringList{QStringLiteral("file:///tmp/a.txt")}, QVariantMap()}));
+        const QDBusPendingCall handOver = m_connection->asyncCall(call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("HandOver"), {}));
+        QTRY_VERIFY(open.isFinished() && handOver.isFinished());
+        QVERIFY(!open.isError());
+        QVERIFY(!handOver.isError());
+        QCOMPARE(events, (QStringList{QStringLiteral("open"), QStringLiteral("handover")}));
+
+        // The name goes to the next in the queue
+        QTRY_COMPARE(QDBusConnection::sessionBus().interface()->serviceOwner(serviceName).value(), m_connection->baseService());
+
+        // The launching process must see that nobody took care of its launch
+        const QList<QDBusMessage> lateCalls{
+            call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"), {QVariantMap()}),
+            call(QStringLiteral("org.freedesktop.Application"), QStringLiteral("ActivateAction"), {QStringLiteral("action"), QVariantList(), QVariantMap()}),
+            call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("CommandLine"), {QStringList{QStringLiteral("app")}, QStringLiteral("/tmp"), QVariantMap()}),
+            call(QStringLiteral("org.kde.KDBusService"), QStringLiteral("HandOver"), {}),
+        };
+        for (const QDBusMessage &message : lateCalls) {
+            const QDBusPendingCall reply = m_connection->asyncCall(message);
+            QTRY_VERIFY(reply.isFinished());
+            QVERIFY2(reply.isError(), qPrintable(message.member()));
+            QCOMPARE(reply.error().name(), QStringLiteral("org.kde.KDBusService.Error.HandedOver"));
+        }
+        QCOMPARE(events.size(), 2);
+    }
+
+private:
+    QDBusMessage call(const QString &interface, const QString &method, const QVariantList &arguments) const
+    {
+        QDBusMessage message = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(), m_objectPath, interface, method);
+        message.setArguments(arguments);
+        return message;
+    }
+
+    std::unique_ptr<KDBusService> m_service;
+    std::unique_ptr<QDBusConnection> m_connection;
+    QString m_objectPath;
+};
+
+QTEST_MAIN(KDBusServiceDispatcherTest)
+
+#include "kdbusservicedispatchertest.moc"
@@ -0,0 +1,334 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QCryptographicHash>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QTest>
+
+#include <memory>
+#include <vector>
+
+static const QString s_serviceName = QStringLiteral("org.kde.kdbussimpleservice");
+
+// Starts kdbussimpleservice processes and checks where their launches end up.
+// Instances print the arguments of each launch handed to them on stdout.
+class KDBusServiceLaunchTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void cleanup()
+    {
+        for (const auto &process : m_processes) {
+            process->kill();
+            process->waitForFinished();
+        }
+        m_processes.clear();
+    }
+
+    void testLoadBalanced()
+    {
+        QProcess *busy = start({QStringLiteral("--multiple"), QStringLiteral("--load"), QStringLiteral("3"), QStringLiteral("--capacity"), QStringLiteral("4")});
+        QProcess *idle = start({QStringLiteral("--multiple"), QStringLiteral("--load"), QStringLiteral("1"), QStringLiteral("--capacity"), QStringLiteral("4")});
+        QProcess *full = start({QStringLiteral("--multiple"), QStringLiteral("--load"), QStringLiteral("2"), QStringLiteral("--capacity"), QStringLiteral("2")});
+        QVERIFY(waitForInstance(busy));
+        QVERIFY(waitForInstance(idle));
+        QVERIFY(waitForInstance(full));
+
+        // The launch goes to the instance with the most headroom and exits with the value set there
+        QProcess *launch = start({QStringLiteral("--load-balanced"), QStringLiteral("--exit-value"), QStringLiteral("7")});
+        QVERIFY(launch->waitForFinished(10000));
+        QCOMPARE(launch->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(launch->exitCode(), 7);
+
+        QVERIFY(idle->waitForReadyRead(5000));
+        QCOMPARE(idle->readAllStandardOutput(), QByteArray("activated --load-balanced --exit-value 7\n"));
+        QVERIFY(!busy->waitForReadyRead(500));
+        QVERIFY(!full->waitForReadyRead(500));
+    }
+
+    void testLoadBalancedSaturated()
+    {
+        // One instance has no room left, the other takes no launches at all
+        QProcess *full = start({QStringLiteral("--multiple"), QStringLiteral("--load"), QStringLiteral("2"), QStringLiteral("--capacity"), QStringLiteral("2")});
+        QProcess *closed = start({QStringLiteral("--multiple")});
+        QVERIFY(waitForInstance(full));
+        QVERIFY(waitForInstance(closed));
+
+        // The launch becomes an instance of its own
+        QProcess *launch = start({QStringLiteral("--load-balanced")});
+        QVERIFY(waitForInstance(launch));
+        QCOMPARE(launch->state(), QProcess::Running);
+        QVERIFY(!full->waitForReadyRead(500));
+        QVERIFY(!closed->waitForReadyRead(500));
+    }
+
+    void testAggregateLaunches()
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        QProcess *primary = start({QStringLiteral("--aggregate")});
+        const qint64 primaryPid = primary->processId();
+        QVERIFY(QTest::qWaitFor(
+            [primaryPid]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == primaryPid;
+            },
+            8000));
+
+        // Started at the same moment, like a script opening several files at once.
+        // The launches report how many launches they forwarded in their debug output.
+        // The window is widened so that a loaded machine starting them slowly still aggregates them.
+        const int count = 6;
+        qputenv("QT_LOGGING_RULES", "kf.dbusaddons.debug=true");
+        qputenv("KDBUSSERVICE_AGGREGATION_WINDOW", "2000");
+        QList<QProcess *> launches;
+        for (int i = 0; i < count; ++i) {
+            launches << start({QStringLiteral("--aggregate"), QStringLiteral("--exit-value"), QString::number(10 + i)}, QProcess::SeparateChannels);
+        }
+        qunsetenv("KDBUSSERVICE_AGGREGATION_WINDOW");
+        qunsetenv("QT_LOGGING_RULES");
+
+        // Each process exits with the value set for its own launch
+        const QRegularExpression forwardedExpression(QStringLiteral("Forwarded (\\d+) launches"));
+        int forwarded = 0;
+        int largestBatch = 0;
+        for (int i = 0; i < count; ++i) {
+            QProcess *launch = launches.at(i);
+            QVERIFY(launch->waitForFinished(10000));
+            QCOMPARE(launch->exitStatus(), QProcess::NormalExit);
+            QCOMPARE(launch->exitCode(), 10 + i);
+
+            const QRegularExpressionMatch match = forwardedExpression.match(QString::fromUtf8(launch->readAllStandardError()));
+            if (match.hasMatch()) {
+                const int batchSize = match.captured(1).toInt();
+                forwarded += batchSize;
+                largestBatch = std::max(largestBatch, batchSize);
+            }
+        }
+
+        // Every launch was part of a batch, and launches started together shared one
+        QCOMPARE(forwarded, count);
+        QVERIFY2(largestBatch > 1, "No launches were forwarded together");
+
+        QByteArray output;
+        QVERIFY(QTest::qWaitFor(
+            [&output, primary]() {
+                primary->waitForReadyRead(100);
+                output += primary->readAllStandardOutput();
+                return output.count("activated") >= count;
+            },
+            5000));
+        for (int i = 0; i < count; ++i) {
+            QVERIFY(output.contains(QStringLiteral("activated --aggregate --exit-value %1\n").arg(10 + i).toUtf8()));
+        }
+    }
+
+    void testLaunchDuringHandOver()
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        QProcess *old = start({QStringLiteral("--hand-over-delay"), QStringLiteral("2000")});
+        const qint64 oldPid = old->processId();
+        QVERIFY(QTest::qWaitFor(
+            [oldPid]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == oldPid;
+            },
+            8000));
+
+        QProcess *replacement = start({QStringLiteral("--replace")});
+        QVERIFY(old->waitForReadyRead(8000));
+        QCOMPARE(old->readAllStandardOutput(), QByteArray("handing over\n"));
+
+        // Reaches the old instance while it hands over, which hands the launch back
+        QProcess *launch = start({QStringLiteral("--exit-value"), QStringLiteral("5")});
+        QVERIFY(launch->waitForFinished(20000));
+        QCOMPARE(launch->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(launch->exitCode(), 5);
+
+        QVERIFY(replacement->waitForReadyRead(5000));
+        QCOMPARE(replacement->readAllStandardOutput(), QByteArray("activated --exit-value 5\n"));
+        QVERIFY(old->waitForFinished(5000));
+        QVERIFY(old->readAllStandardOutput().isEmpty());
+    }
+
+    void testHandOverState()
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        QProcess *old = start({QStringLiteral("--state"), QStringLiteral("documents")});
+        const qint64 oldPid = old->processId();
+        QVERIFY(QTest::qWaitFor(
+            [oldPid]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == oldPid;
+            },
+            8000));
+
+        // The replacement gets the state and is the only instance left
+        QProcess *replacement = start({QStringLiteral("--replace")});
+        QVERIFY(old->waitForFinished(10000));
+        QCOMPARE(old->readAllStandardOutput(), QByteArray("handing over\n"));
+
+        QByteArray output;
+        QVERIFY(QTest::qWaitFor(
+            [&output, replacement]() {
+                replacement->waitForReadyRead(100);
+                output += replacement->readAllStandardOutput();
+                return output.contains("instances");
+            },
+            8000));
+        QCOMPARE(output, QStringLiteral("received documents\nstate handed over documents, instances %1\n").arg(s_serviceName).toUtf8());
+        QCOMPARE(qint64(QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value()), replacement->processId());
+    }
+
+    void testPreload()
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        // Started hidden, with nothing to show yet
+        QProcess *preloaded = start({QStringLiteral("--preload")});
+        QVERIFY(preloaded->waitForReadyRead(8000));
+        QCOMPARE(preloaded->readAllStandardOutput(), QByteArray("preloaded\n"));
+        QCOMPARE(qint64(QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value()), preloaded->processId());
+
+        // Preloading again neither starts a second instance nor brings up the first
+        QProcess *again = start({QStringLiteral("--preload")});
+        QVERIFY(again->waitForFinished(10000));
+        QCOMPARE(again->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(again->exitCode(), 0);
+        QVERIFY(!preloaded->waitForReadyRead(500));
+
+        // The first launch leaves the preloaded state right before it is handled
+        QProcess *launch = start({QStringLiteral("--exit-value"), QStringLiteral("4")});
+        QVERIFY(launch->waitForFinished(10000));
+        QCOMPARE(launch->exitCode(), 4);
+        QByteArray output;
+        QVERIFY(QTest::qWaitFor(
+            [&output, preloaded]() {
+                preloaded->waitForReadyRead(100);
+                output += preloaded->readAllStandardOutput();
+                return output.contains("activated --exit-value 4\n");
+            },
+            5000));
+        QCOMPARE(output, QByteArray("preload activated, preloaded false\nactivated --exit-value 4\n"));
+
+        // Later launches are plain activations
+        launch = start({QStringLiteral("--exit-value"), QStringLiteral("5")});
+        QVERIFY(launch->waitForFinished(10000));
+        QCOMPARE(launch->exitCode(), 5);
+        QVERIFY(preloaded->waitForReadyRead(5000));
+        QCOMPARE(preloaded->readAllStandardOutput(), QByteArray("activated --exit-value 5\n"));
+    }
+
+    void testLaunchLatency()
+    {
+        QTRY_VERIFY_WITH_TIMEOUT(!QDBusConnection::sessionBus().interface()->isServiceRegistered(s_serviceName).value(), 8000);
+
+        QProcess *primary = start({QStringLiteral("--report-latency")});
+        const qint64 primaryPid = primary->processId();
+        QVERIFY(QTest::qWaitFor(
+            [primaryPid]() {
+                return QDBusConnection::sessionBus().interface()->servicePid(s_serviceName).value() == primaryPid;
+            },
+            8000));
+
+        // Measured once the forwarded launch has been handled, for the process that forwarded it
+        QProcess *launch = start({QStringLiteral("--exit-value"), QStringLiteral("2")});
+        const qint64 launchPid = launch->processId();
+        QVERIFY(launch->waitForFinished(10000));
+        QCOMPARE(launch->exitCode(), 2);
+
+        QByteArray output;
+        QVERIFY(QTest::qWaitFor(
+            [&output, primary]() {
+                primary->waitForReadyRead(100);
+                output += primary->readAllStandardOutput();
+                return output.contains("measured");
+            },
+            5000));
+        QCOMPARE(output, QStringLiteral("activated --exit-value 2\nlaunch from %1 measured\n").arg(launchPid).toUtf8());
+    }
+
+    void testSharded()
+    {
+        const QString shardA = shardName(QStringLiteral("a"));
+        const QString shardB = shardName(QStringLiteral("b"));
+        QVERIFY(shardA != shardB);
+
+        // Names sharing the prefix without being shards of the application are left out
+        const QStringList decoys{s_serviceName + QStringLiteral(".shard_garbage"), s_serviceName + QStringLiteral("x.shard_0123456789abcdef")};
+        for (const QString &decoy : decoys) {
+            QVERIFY(QDBusConnection::sessionBus().registerService(decoy));
+        }
+
+        // Different keys make two primaries
+        QProcess *a = start({QStringLiteral("--routing-key"), QStringLiteral("a")});
+        QVERIFY(a->waitForReadyRead(8000));
+        QCOMPARE(a->readAllStandardOutput(), QStringLiteral("sharded a: %1\n").arg(shardA).toUtf8());
+
+        QProcess *b = start({QStringLiteral("--routing-key"), QStringLiteral("b")});
+        QVERIFY(b->waitForReadyRead(8000));
+        QStringList shards{shardA, shardB};
+        shards.sort();
+        QCOMPARE(b->readAllStandardOutput(), QStringLiteral("sharded b: %1\n").arg(shards.join(QLatin1Char(' '))).toUtf8());
+        QCOMPARE(a->state(), QProcess::Running);
+
+        // The same key goes to the instance serving it
+        QProcess *launch = start({QStringLiteral("--routing-key"), QStringLiteral("a"), QStringLiteral("--exit-value"), QStringLiteral("3")});
+        QVERIFY(launch->waitForFinished(10000));
+        QCOMPARE(launch->exitStatus(), QProcess::NormalExit);
+        QCOMPARE(launch->exitCode(), 3);
+
+        QVERIFY(a->waitForReadyRead(5000));
+        QCOMPARE(a->readAllStandardOutput(), QByteArray("activated --routing-key a --exit-value 3\n"));
+        QVERIFY(!b->waitForReadyRead(500));
+
+        for (const QString &decoy : decoys) {
+            QDBusConnection::sessionBus().unregisterService(decoy);
+        }
+    }
+
+private:
+    // The name KDBusService registers for the shard of @p routingKey
+    static QString shardName(const QString &routingKey)
+    {
+        const QByteArray hash = QCryptographicHash::hash(routingKey.toUtf8(), QCryptographicHash::Sha256);
+        return s_serviceName + QStringLiteral(".shard_") + QString::fromLatin1(hash.left(8).toHex());
+    }
+
+    QProcess *start(const QStringList &arguments, QProcess::ProcessChannelMode channelMode = QProcess::ForwardedErrorChannel)
+    {
+        auto process = std::make_unique<QProcess>();
+        process->setProgram(QFINDTESTDATA("kdbussimpleservice"));
+        process->setArguments(arguments);
+        process->setProcessChannelMode(channelMode);
+        process->start();
+        process->waitForStarted();
+        m_processes.push_back(std::move(process));
+        return m_processes.back().get();
+    }
+
+    // Waits until @p process has registered its per-process name
+    static bool waitForInstance(QProcess *process)
+    {
+        const QString name = s_serviceName + QLatin1Char('-') + QString::number(process->processId());
+        return QTest::qWaitFor(
+            [&name]() {
+                return QDBusConnection::sessionBus().interface()->isServiceRegistered(name).value();
+            },
+            8000);
+    }
+
+    std::vector<std::unique_ptr<QProcess>> m_processes;
+};
+
+QTEST_MAIN(KDBusServiceLaunchTest)
+
+#include "kdbusservicelaunchtest.moc"
@@ -8,6 +8,7 @@
 
 #include <QCoreApplication>
 #include <QDebug>
+#include <QTextStream>
 #include <QThread>
 #include <kdbusservice.h>
 
@@ -43,6 +44,26 @@ void usr1_handler(int signum)
     abort();
 }
 
+// Returns the number following @p option in @p arguments, or @p defaultValue
+static int intArgument(const QStringList &arguments, const QString &option, int defaultValue)
+{
+    const qsizetype index = arguments.indexOf(option);
+    if (index < 0 || index + 1 >= arguments.size()) {
+        return defaultValue;
+    }
+    return arguments.at(index + 1).toInt();
+}
+
+// Returns the string following @p option in @p arguments, or an empty string
+static QString stringArgument(const QStringList &arguments, const QString &option)
+{
+    const qsizetype index = arguments.indexOf(option);
+    if (index < 0 || index + 1 >= arguments.size()) {
+        return QString();
+    }
+    return arguments.at(index + 1);
+}
+
 // Simple application under test.
 // Closes all sockets on USR1 and aborts to simulate a kcrash shutdown behavior
 // which can result in a service registration race.
@@ -66,12 +87,84 @@ int main(int argc, char *argv[])
     QCoreApplication::setApplicationName("kdbussimpleservice");
     QCoreApplication::setOrganizationDomain("kde.org");
 
-    KDBusService service(KDBusService::Unique);
-    if (!service.isRegistered()) {
+    const QStringList arguments = app.arguments();
+    KDBusService::StartupOptions options = KDBusService::Unique;
+    if (arguments.contains(QLatin1String("--multiple"))) {
+        options = KDBusService::Multiple;
+    } else if (arguments.contains(QLatin1String("--load-balanced"))) {
+        options = KDBusService::Multiple | KDBusService::LoadBalanced;
+    }
+    if (arguments.contains(QLatin1String("--standby"))) {
+        options |= KDBusService::Standby;
+    }
+    if (arguments.contains(QLatin1String("--aggregate"))) {
+        options |= KDBusService::AggregateLaunches;
+    }
+    if (arguments.contains(QLatin1String("--replace"))) {
+        options |= KDBusService::Replace;
+    }
+    if (arguments.contains(QLatin1String("--preload"))) {
+        options |= KDBusService::Preload;
+    }
+
+    KDBusService service(options, stringArgument(arguments, QLatin1String("--routing-key")));
+    if (arguments.contains(QLatin1String("--capacity"))) {
+        service.setLoadHint(intArgument(arguments, QLatin1String("--load"), 0), intArgument(arguments, QLatin1String("--capacity"), 0));
+    }
+
+    // Launches handed to us are reported on stdout and get the exit value they ask for.
+    QObject::connect(&service, &KDBusService::activateRequested, &app, [&service](const QStringList &launchArguments) {
+        service.setExitValue(intArgument(launchArguments, QLatin1String("--exit-value"), 0));
+        QTextStream(stdout) << "activated " << launchArguments.mid(1).join(QLatin1Char(' ')) << Qt::endl;
+    });
+
+    if (arguments.contains(QLatin1String("--report-latency"))) {
+        QObject::connect(&service, &KDBusService::launchLatencyMeasured, &app, [](qint64 launcherPid) {
+            QTextStream(stdout) << "launch from " << launcherPid << " measured" << Qt::endl;
+        });
+    }
+
+    QObject::connect(&service, &KDBusService::preloadActivated, &app, [&service]() {
+        QTextStream(stdout) << "preload activated, preloaded " << (service.isPreloaded() ? "true" : "false") << Qt::endl;
+    });
+
+    // Keeps the hand-over going for a while, so that launches can reach us in the meantime
+    QObject::connect(&service, &KDBusService::handOverRequested, &app, [&service, &arguments]() {
+        QTextStream(stdout) << "handing over" << Qt::endl;
+        QThread::msleep(intArgument(arguments, QLatin1String("--hand-over-delay"), 0));
+        service.setHandOverState(stringArgument(arguments, QLatin1String("--state")).toUtf8());
+    });
+
+    // The state of the replaced instance is there right away, and signalled once the event loop runs
+    if (!service.handedOverState().isEmpty()) {
+        QTextStream(stdout) << "received " << service.handedOverState() << Qt::endl;
+    }
+    QObject::connect(&service, &KDBusService::stateHandedOver, &app, [&service](const QByteArray &state) {
+        QTextStream(stdout) << "state handed over " << state << ", instances " << service.runningInstances().join(QLatin1Char(' ')) << Qt::endl;
+    });
+
+    if (service.isStandby()) {
+        qDebug() << "service on standby";
+        QObject::connect(&service, &KDBusService::promoted, &app, []() {
+            qDebug() << "service promoted";
+        });
+    } else if (!service.isRegistered()) {
         qDebug() << "service not registered => exiting";
         return 1;
+    } else {
+        qDebug() << "service registered";
+    }
+
+    if (service.isPreloaded()) {
+        QTextStream(stdout) << "preloaded" << Qt::endl;
+    }
+
+    // Sharded instances report their key and the shards running next to them
+    if (!service.routingKey().isEmpty()) {
+        QStringList shards = service.runningShards();
+        shards.sort();
+        QTextStream(stdout) << "sharded " << service.routingKey() << ": " << shards.join(QLatin1Char(' ')) << Qt::endl;
     }
-    qDebug() << "service registered";
 
     int ret = app.exec();
     qDebug() << "exiting deadservice";
@@ -0,0 +1,76 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDBusConnection>
+#include <QTest>
+
+#include <kdedmodule.h>
+
+#include <memory>
+#include <vector>
+
+// Startup of a daemon loading this many modules
+static const int s_moduleCount = 200;
+
+class KDEDModuleRegistrationBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init()
+    {
+        for (int i = 0; i < s_moduleCount; ++i) {
+            m_modules.push_back(std::make_unique<KDEDModule>());
+            m_moduleList.append(m_modules.back().get());
+            m_names.append(QStringLiteral("benchmark%1").arg(i));
+        }
+    }
+
+    void cleanup()
+    {
+        m_moduleList.clear();
+        m_modules.clear();
+        m_names.clear();
+    }
+
+    void benchmarkSetModuleName()
+    {
+        QBENCHMARK {
+            for (int i = 0; i < s_moduleCount; ++i) {
+                m_moduleList.at(i)->setModuleName(m_names.at(i));
+            }
+            QCoreApplication::processEvents();
+            unregisterAll();
+        }
+    }
+
+    void benchmarkRegisterModules()
+    {
+        QBENCHMARK {
+            KDEDModule::registerModules(m_moduleList, m_names);
+            QCoreApplication::processEvents();
+            unregisterAll();
+        }
+    }
+
+private:
+    void unregisterAll()
+    {
+        for (const QString &name : std::as_const(m_names)) {
+            QDBusConnection::sessionBus().unregisterObject(QLatin1String("/modules/") + name);
+        }
+    }
+
+    std::vector<std::unique_ptr<KDEDModule>> m_modules;
+    QList<KDEDModule *> m_moduleList;
+    QStringList m_names;
+};
+
+QTEST_MAIN(KDEDModuleRegistrationBenchmark)
+
+#include "kdedmoduleregistrationbenchmark.moc"
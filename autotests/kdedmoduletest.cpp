@@ -0,0 +1,403 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDBusConnection>
+#include <QDBusContext>
+#include <QDBusObjectPath>
+#include <QDBusPendingReply>
+#include <QDBusUnixFileDescriptor>
+#include <QDBusVariant>
+#include <QRegularExpression>
+#include <QSemaphore>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <kdedmodule.h>
+
+#include <memory>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+class AsyncModule : public KDEDModule, public QDBusContext
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.AsyncModule")
+
+public:
+    ~AsyncModule() override
+    {
+        waitForAsyncCalls();
+    }
+
+    QSemaphore release;
+
+public Q_SLOTS:
+    Q_SCRIPTABLE int square(int value)
+    {
+        runAsync([this, value](const QDBusMessage &request) {
+            release.acquire();
+            return request.createReply(value * value);
+        });
+        return 0;
+    }
+
+    Q_SCRIPTABLE int ping()
+    {
+        return 1;
+    }
+};
+
+// Receives the signals of the module on a second connection
+class SignalReceiver : public QObject
+{
+    Q_OBJECT
+
+public Q_SLOTS:
+    void propertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated)
+    {
+        Q_UNUSED(invalidated);
+        Q_EMIT propertiesReceived(interface, changed);
+    }
+
+    void stateChanged(int state)
+    {
+        Q_EMIT stateReceived(state);
+    }
+
+Q_SIGNALS:
+    void propertiesReceived(const QString &interface, const QVariantMap &changed);
+    void stateReceived(int state);
+};
+
+class KDEDModuleTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPayload_data()
+    {
+        QTest::addColumn<qsizetype>("size");
+        QTest::addColumn<bool>("inlined");
+
+        QTest::newRow("empty") << qsizetype(0) << true;
+        QTest::newRow("small") << qsizetype(100) << true;
+        QTest::newRow("threshold") << KDEDModule::defaultPayloadInlineThreshold << true;
+        QTest::newRow("large") << qsizetype(4 * 1024 * 1024) << false;
+    }
+
+    void testPayload()
+    {
+        QFETCH(qsizetype, size);
+        QFETCH(bool, inlined);
+#ifndef Q_OS_LINUX
+        inlined = true; // no memfd
+#endif
+
+        const QDBusConnection connection = QDBusConnection::sessionBus();
+        if (!inlined && !(connection.connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing)) {
+            QSKIP("The bus does not support passing file descriptors");
+        }
+
+        QByteArray data(size, Qt::Uninitialized);
+        for (qsizetype i = 0; i < size; ++i) {
+            data[i] = char(i % 251);
+        }
+
+        const QDBusVariant payload = KDEDModule::encodePayload(data, connection);
+        QCOMPARE(payload.variant().metaType() == QMetaType::fromType<QByteArray>(), inlined);
+#ifdef Q_OS_LINUX
+        QCOMPARE(payload.variant().metaType() == QMetaType::fromType<QDBusUnixFileDescriptor>(), !inlined);
+#endif
+        QCOMPARE(KDEDModule::decodePayload(payload), data);
+
+        const KDEDModule::MappedPayload mapped = KDEDModule::mapPayload(payload);
+        QVERIFY(mapped);
+        QCOMPARE(mapped.data().size(), data.size());
+        QCOMPARE(mapped.toByteArray(), data);
+    }
+
+    void testPayloadLimit()
+    {
+        const QDBusConnection connection = QDBusConnection::sessionBus();
+#ifdef Q_OS_LINUX
+        if (!(connection.connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing)) {
+            QSKIP("The bus does not support passing file descriptors");
+        }
+#else
+        QSKIP("Payloads are only passed as file descriptors on Linux");
+#endif
+
+        const QByteArray data(1024, 'x');
+        const QDBusVariant payload = KDEDModule::encodePayload(data, connection, 0);
+        QCOMPARE(KDEDModule::decodePayload(payload, data.size()), data);
+        QVERIFY(KDEDModule::decodePayload(payload, data.size() - 1).isNull());
+        QVERIFY(!KDEDModule::mapPayload(payload, data.size() - 1));
+    }
+
+    void testPayloadNotAFile()
+    {
+#ifdef Q_OS_LINUX
+        // A pipe has no size, it must not pass for an empty payload
+        int fds[2];
+        QCOMPARE(pipe(fds), 0);
+        const QDBusVariant payload(QVariant::fromValue(QDBusUnixFileDescriptor(fds[0])));
+        close(fds[0]);
+        close(fds[1]);
+
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("not a regular file")));
+        QVERIFY(KDEDModule::decodePayload(payload).isNull());
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("not a regular file")));
+        QVERIFY(!KDEDModule::mapPayload(payload));
+#else
+        QSKIP("Payloads are only passed as file descriptors on Linux");
+#endif
+    }
+
+    void testRunAsync()
+    {
+        AsyncModule module;
+        module.setModuleName(QStringLiteral("asynctest"));
+        module.setMaxConcurrentAsyncCalls(2);
+        module.setMaxQueuedAsyncCalls(1);
+        QCOMPARE(module.maxConcurrentAsyncCalls(), 2);
+
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("asynctest"));
+        auto call = [&connection](int value) {
+            QDBusMessage message = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(),
+                                                                  QStringLiteral("/modules/asynctest"),
+                                                                  QStringLiteral("org.kde.AsyncModule"),
+                                                                  QStringLiteral("square"));
+            message << value;
+            return QDBusPendingReply<int>(connection.asyncCall(message));
+        };
+
+        QList<QDBusPendingReply<int>> replies;
+        for (int i = 1; i <= 3; ++i) {
+            replies.append(call(i));
+        }
+        QTRY_COMPARE(module.activeAsyncCalls(), 2);
+        QTRY_COMPARE(module.queuedAsyncCalls(), 1);
+
+        // The queue is full
+        // Calls to ourselves are handled on this thread, so wait with the event loop running
+        QDBusPendingReply<int> rejected = call(4);
+        QTRY_VERIFY(rejected.isFinished());
+        QCOMPARE(rejected.error().type(), QDBusError::LimitsExceeded);
+
+        // Calls handled on the main thread still get through while the workers are blocked
+        QDBusMessage ping = QDBusMessage::createMethodCall(QDBusConnection::sessionBus().baseService(),
+                                                           QStringLiteral("/modules/asynctest"),
+                                                           QStringLiteral("org.kde.AsyncModule"),
+                                                           QStringLiteral("ping"));
+        QDBusPendingReply<int> pong = connection.asyncCall(ping);
+        QTRY_VERIFY(pong.isFinished());
+        QCOMPARE(pong.value(), 1);
+        QCOMPARE(module.activeAsyncCalls(), 2);
+
+        module.release.release(3);
+        for (int i = 0; i < replies.size(); ++i) {
+            QTRY_VERIFY(replies.at(i).isFinished());
+            QVERIFY(replies.at(i).isValid());
+            QCOMPARE(replies.at(i).value(), (i + 1) * (i + 1));
+        }
+        QTRY_COMPARE(module.activeAsyncCalls(), 0);
+
+        QDBusConnection::disconnectFromBus(QStringLiteral("asynctest"));
+    }
+
+    void testPeerConnections()
+    {
+#ifndef Q_OS_UNIX
+        QSKIP("Peer connections listen on a unix socket");
+#endif
+        const QString address = KDEDModule::enablePeerConnections();
+        QVERIFY(!address.isEmpty());
+        QCOMPARE(KDEDModule::enablePeerConnections(), address);
+
+        KDEDModule module;
+        module.setModuleName(QStringLiteral("peertest"));
+
+        QDBusConnection peer = KDEDModule::connectToPeer(QDBusConnection::sessionBus().baseService());
+        QVERIFY(peer.isConnected());
+        QVERIFY(peer.name() != QDBusConnection::sessionBus().name());
+        QCOMPARE(KDEDModule::connectToPeer(QDBusConnection::sessionBus().baseService()).name(), peer.name());
+
+        // The module is exported on the peer connection
+        const QDBusMessage message = QDBusMessage::createMethodCall(QString(),
+                                                                    QStringLiteral("/modules/peertest"),
+                                                                    QStringLiteral("org.freedesktop.DBus.Introspectable"),
+                                                                    QStringLiteral("Introspect"));
+        QDBusPendingReply<QString> reply = peer.asyncCall(message);
+        QTRY_VERIFY(reply.isFinished());
+        QVERIFY2(reply.isValid(), qPrintable(reply.error().message()));
+        QVERIFY(reply.value().contains(QLatin1String("org.freedesktop.DBus.Introspectable")));
+    }
+
+    void testRename()
+    {
+        KDEDModule module;
+        module.setModuleName(QStringLiteral("renametest1"));
+        module.setModuleName(QStringLiteral("renametest2"));
+        QCOMPARE(module.moduleName(), QStringLiteral("renametest2"));
+        QVERIFY(!QDBusConnection::sessionBus().objectRegisteredAt(QStringLiteral("/modules/renametest1")));
+        QCOMPARE(QDBusConnection::sessionBus().objectRegisteredAt(QStringLiteral("/modules/renametest2")), static_cast<QObject *>(&module));
+    }
+
+    void testRegisterModules()
+    {
+        std::vector<std::unique_ptr<KDEDModule>> modules;
+        QList<KDEDModule *> moduleList;
+        QStringList names;
+        std::vector<std::unique_ptr<QSignalSpy>> spies;
+        for (int i = 0; i < 10; ++i) {
+            modules.push_back(std::make_unique<KDEDModule>());
+            moduleList.append(modules.back().get());
+            names.append(QStringLiteral("bulktest%1").arg(i));
+            spies.push_back(std::make_unique<QSignalSpy>(modules.back().get(), &KDEDModule::moduleRegistered));
+        }
+
+        KDEDModule::registerModules(moduleList, names);
+
+        for (int i = 0; i < moduleList.size(); ++i) {
+            QCOMPARE(moduleList.at(i)->moduleName(), names.at(i));
+            QVERIFY(QDBusConnection::sessionBus().objectRegisteredAt(QLatin1String("/modules/") + names.at(i)));
+        }
+
+        // Deleted modules are skipped
+        modules.erase(modules.begin());
+        spies.erase(spies.begin());
+
+        QTRY_COMPARE(spies.back()->count(), 1);
+        for (int i = 0; i < int(spies.size()); ++i) {
+            QCOMPARE(spies.at(i)->count(), 1);
+            QCOMPARE(spies.at(i)->at(0).at(0).value<QDBusObjectPath>().path(), QLatin1String("/modules/") + names.at(i + 1));
+        }
+    }
+
+    void testRegisterModulesSizeMismatch()
+    {
+        KDEDModule first;
+        KDEDModule second;
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("Cannot register")));
+        KDEDModule::registerModules({&first, &second}, {QStringLiteral("mismatchtest")});
+        QVERIFY(first.moduleName().isEmpty());
+    }
+
+    void testRegisterModulesInvalidEntries()
+    {
+        KDEDModule module;
+        QSignalSpy spy(&module, &KDEDModule::moduleRegistered);
+
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("null kded module")));
+        QTest::ignoreMessage(QtWarningMsg, QRegularExpression(QStringLiteral("listed more than once")));
+        KDEDModule::registerModules({nullptr, &module, &module}, {QStringLiteral("nullmodule"), QStringLiteral("first"), QStringLiteral("second")});
+
+        QCOMPARE(module.moduleName(), QStringLiteral("first"));
+        QVERIFY(!QDBusConnection::sessionBus().objectRegisteredAt(QStringLiteral("/modules/nullmodule")));
+        QVERIFY(!QDBusConnection::sessionBus().objectRegisteredAt(QStringLiteral("/modules/second")));
+        QTRY_COMPARE(spy.count(), 1);
+    }
+
+    void testWindowRegistry()
+    {
+        KDEDModule first;
+        KDEDModule second;
+        QSignalSpy registeredSpy(&first, &KDEDModule::windowsRegistered);
+        QSignalSpy unregisteredSpy(&first, &KDEDModule::windowsUnregistered);
+        QSignalSpy secondSpy(&second, &KDEDModule::windowsRegistered);
+        QSignalSpy legacyRegisteredSpy(&first, &KDEDModule::windowRegistered);
+        QSignalSpy legacyUnregisteredSpy(&first, &KDEDModule::windowUnregistered);
+
+        for (qlonglong window = 10; window > 0; --window) {
+            KDEDModule::registerWindow(window);
+        }
+        KDEDModule::registerWindow(5);
+        KDEDModule::unregisterWindow(10);
+
+        QVERIFY(KDEDModule::isWindowRegistered(1));
+        QVERIFY(!KDEDModule::isWindowRegistered(10));
+        QCOMPARE(KDEDModule::registeredWindows(), (QList<qlonglong>{1, 2, 3, 4, 5, 6, 7, 8, 9}));
+
+        // One batch for all of them, a window that came and went is not announced
+        QTRY_COMPARE(registeredSpy.count(), 1);
+        QCOMPARE(registeredSpy.at(0).at(0).value<QList<qlonglong>>(), (QList<qlonglong>{1, 2, 3, 4, 5, 6, 7, 8, 9}));
+        QCOMPARE(secondSpy.count(), 1);
+        QCOMPARE(unregisteredSpy.count(), 0);
+
+        // The per-window signals follow for each window in the batch
+        QCOMPARE(legacyRegisteredSpy.count(), 9);
+        QCOMPARE(legacyRegisteredSpy.first().at(0).toLongLong(), qlonglong(1));
+        QCOMPARE(legacyUnregisteredSpy.count(), 0);
+
+        KDEDModule::unregisterWindow(3);
+        KDEDModule::unregisterWindow(4);
+        KDEDModule::unregisterWindow(4);
+        KDEDModule::unregisterWindow(5);
+        KDEDModule::registerWindow(5);
+        QTRY_COMPARE(unregisteredSpy.count(), 1);
+        QCOMPARE(unregisteredSpy.at(0).at(0).value<QList<qlonglong>>(), (QList<qlonglong>{3, 4}));
+        QCOMPARE(registeredSpy.count(), 1);
+        QCOMPARE(legacyUnregisteredSpy.count(), 2);
+        QCOMPARE(legacyRegisteredSpy.count(), 9);
+
+        for (qlonglong window : KDEDModule::registeredWindows()) {
+            KDEDModule::unregisterWindow(window);
+        }
+        QVERIFY(KDEDModule::registeredWindows().isEmpty());
+    }
+
+    void testCoalescedChanges()
+    {
+        KDEDModule module;
+        module.setModuleName(QStringLiteral("coalescingtest"));
+        module.setChangeCoalescingInterval(50);
+        QCOMPARE(module.changeCoalescingInterval(), 50);
+
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("coalescingtest"));
+        const QString path = QStringLiteral("/modules/coalescingtest");
+        SignalReceiver receiver;
+        QVERIFY(connection.connect(QString(),
+                                   path,
+                                   QStringLiteral("org.freedesktop.DBus.Properties"),
+                                   QStringLiteral("PropertiesChanged"),
+                                   &receiver,
+                                   SLOT(propertiesChanged(QString, QVariantMap, QStringList))));
+        QVERIFY(connection.connect(QString(), path, QStringLiteral("org.kde.Test"), QStringLiteral("StateChanged"), &receiver, SLOT(stateChanged(int))));
+        QSignalSpy propertiesSpy(&receiver, &SignalReceiver::propertiesReceived);
+        QSignalSpy stateSpy(&receiver, &SignalReceiver::stateReceived);
+
+        for (int i = 0; i < 10; ++i) {
+            module.notifyPropertyChanged(QStringLiteral("org.kde.Test"), QStringLiteral("Counter"), i);
+            module.emitCoalescedSignal(QStringLiteral("org.kde.Test"), QStringLiteral("StateChanged"), {i});
+        }
+        module.notifyPropertyChanged(QStringLiteral("org.kde.Test"), QStringLiteral("Name"), QStringLiteral("test"));
+
+        QTRY_COMPARE(propertiesSpy.count(), 1);
+        QTRY_COMPARE(stateSpy.count(), 1);
+        QCOMPARE(propertiesSpy.at(0).at(0).toString(), QStringLiteral("org.kde.Test"));
+        const QVariantMap changed = propertiesSpy.at(0).at(1).toMap();
+        QCOMPARE(changed.size(), 2);
+        QCOMPARE(changed.value(QStringLiteral("Counter")).toInt(), 9);
+        QCOMPARE(changed.value(QStringLiteral("Name")).toString(), QStringLiteral("test"));
+        QCOMPARE(stateSpy.at(0).at(0).toInt(), 9);
+
+        // Nothing else is pending
+        QTest::qWait(100);
+        QCOMPARE(propertiesSpy.count(), 1);
+        QCOMPARE(stateSpy.count(), 1);
+
+        QDBusConnection::disconnectFromBus(QStringLiteral("coalescingtest"));
+    }
+};
+
+QTEST_MAIN(KDEDModuleTest)
+
+#include "kdedmoduletest.moc"
@@ -0,0 +1,269 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QSignalSpy>
+#include <QTest>
+
+#include <klaunchenvironment.h>
+#include <kupdatelaunchenvironmentjob.h>
+
+#include <memory>
+#include <vector>
+
+static const QString s_variable = QStringLiteral("KLAUNCHENVIRONMENTTEST_VARIABLE");
+static const QString s_systemdService = QStringLiteral("org.freedesktop.systemd1");
+static const QString s_systemdPath = QStringLiteral("/org/freedesktop/systemd1");
+static const QString s_managerConnection = QStringLiteral("fakesystemd");
+
+// Stands in for the systemd user manager, so the tests leave the real one alone.
+// Like the real one, it does not announce changes of its environment.
+class FakeManager : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.freedesktop.systemd1.Manager")
+    Q_PROPERTY(QStringList Environment READ assignments)
+
+public:
+    QStringList assignments() const
+    {
+        QStringList assignments;
+        for (auto it = environment.cbegin(); it != environment.cend(); ++it) {
+            assignments.append(it.key() + QLatin1Char('=') + it.value());
+        }
+        return assignments;
+    }
+
+    // Changes the environment the way another process would
+    void setExternally(const QString &name, const QString &value)
+    {
+        environment.insert(name, value);
+    }
+
+    QMap<QString, QString> environment;
+    int calls = 0;
+
+public Q_SLOTS:
+    void SetEnvironment(const QStringList &assignments)
+    {
+        UnsetAndSetEnvironment(QStringList(), assignments);
+    }
+
+    void UnsetAndSetEnvironment(const QStringList &names, const QStringList &assignments)
+    {
+        ++calls;
+        for (const QString &name : names) {
+            environment.remove(name);
+        }
+        for (const QString &assignment : assignments) {
+            const qsizetype separator = assignment.indexOf(QLatin1Char('='));
+            environment.insert(assignment.left(separator), assignment.mid(separator + 1));
+        }
+    }
+};
+
+// Stands in for plasma-session
+class FakeStartup : public QObject
+{
+    Q_OBJECT
+    Q_CLASSINFO("D-Bus Interface", "org.kde.Startup")
+
+public Q_SLOTS:
+    void updateLaunchEnv(const QString &name, const QString &value)
+    {
+        environment.insert(name, value);
+    }
+
+public:
+    QMap<QString, QString> environment;
+};
+
+class KLaunchEnvironmentTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testSetAndUnset()
+    {
+        if (QDBusConnection::sessionBus().interface()->isServiceRegistered(s_systemdService)) {
+            QSKIP("A systemd user manager is running on the session bus");
+        }
+
+        FakeManager manager;
+        manager.environment.insert(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING"), QStringLiteral("existing"));
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, s_managerConnection);
+        QVERIFY(connection.registerObject(s_systemdPath, &manager, QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllProperties));
+        QVERIFY(connection.registerService(s_systemdService));
+
+        auto launchEnvironment = KLaunchEnvironment::self();
+        QTRY_VERIFY(launchEnvironment->isLoaded());
+        QCOMPARE(launchEnvironment->value(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING")), QStringLiteral("existing"));
+        QSignalSpy changedSpy(launchEnvironment, &KLaunchEnvironment::changed);
+
+        QProcessEnvironment environment;
+        environment.insert(s_variable, QStringLiteral("value"));
+        update(environment, {});
+        QCOMPARE(manager.calls, 1);
+        QCOMPARE(launchEnvironment->value(s_variable), QStringLiteral("value"));
+        QVERIFY(launchEnvironment->environment().contains(s_variable));
+        QVERIFY(!changedSpy.isEmpty());
+
+        // Setting the same value again is left out
+        changedSpy.clear();
+        update(environment, {});
+        QCOMPARE(manager.calls, 1);
+        QCOMPARE(launchEnvironment->value(s_variable), QStringLiteral("value"));
+        QVERIFY(changedSpy.isEmpty());
+
+        // Changes made by others show up once the copy is read again
+        manager.setExternally(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING"), QStringLiteral("changed"));
+        QCOMPARE(launchEnvironment->value(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING")), QStringLiteral("existing"));
+        launchEnvironment->reload();
+        QTRY_COMPARE(launchEnvironment->value(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING")), QStringLiteral("changed"));
+
+        // Once another process changed it, setting our value is no longer a no-op.
+        // The update reads the environment, so the copy has the other changes as well.
+        manager.setExternally(s_variable, QStringLiteral("other"));
+        manager.setExternally(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING"), QStringLiteral("updated"));
+        update(environment, {});
+        QCOMPARE(manager.calls, 2);
+        QCOMPARE(manager.environment.value(s_variable), QStringLiteral("value"));
+        QCOMPARE(launchEnvironment->value(s_variable), QStringLiteral("value"));
+        QCOMPARE(launchEnvironment->value(QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING")), QStringLiteral("updated"));
+
+        update(QProcessEnvironment(), {s_variable});
+        QCOMPARE(manager.calls, 3);
+        QVERIFY(!manager.environment.contains(s_variable));
+        QVERIFY(!launchEnvironment->contains(s_variable));
+        QCOMPARE(launchEnvironment->value(s_variable, QStringLiteral("default")), QStringLiteral("default"));
+
+        // Unsetting what is not set is left out as well
+        update(QProcessEnvironment(), {s_variable});
+        QCOMPARE(manager.calls, 3);
+
+        connection.unregisterService(s_systemdService);
+        connection.unregisterObject(s_systemdPath);
+        QDBusConnection::disconnectFromBus(s_managerConnection);
+    }
+
+    void testMergedUpdates()
+    {
+        if (QDBusConnection::sessionBus().interface()->isServiceRegistered(s_systemdService)) {
+            QSKIP("A systemd user manager is running on the session bus");
+        }
+
+        const QString first = QStringLiteral("KLAUNCHENVIRONMENTTEST_FIRST");
+        const QString second = QStringLiteral("KLAUNCHENVIRONMENTTEST_SECOND");
+        const QString existing = QStringLiteral("KLAUNCHENVIRONMENTTEST_EXISTING");
+        FakeManager manager;
+        manager.environment.insert(existing, QStringLiteral("existing"));
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, s_managerConnection);
+        QVERIFY(connection.registerObject(s_systemdPath, &manager, QDBusConnection::ExportAllSlots | QDBusConnection::ExportAllProperties));
+        QVERIFY(connection.registerService(s_systemdService));
+
+        // Jobs started before the event loop runs again go out in one call, the last job setting a variable wins
+        QList<std::pair<QProcessEnvironment, QStringList>> updates{
+            {environmentWith(first, QStringLiteral("1")), {}},
+            {environmentWith(first, QStringLiteral("2")), {}},
+            {environmentWith(second, QStringLiteral("second")), {}},
+            {QProcessEnvironment(), {existing}},
+            {environmentWith(first, QStringLiteral("3")), {}},
+        };
+        runTogether(updates);
+        QCOMPARE(manager.calls, 1);
+        QCOMPARE(manager.environment.value(first), QStringLiteral("3"));
+        QCOMPARE(manager.environment.value(second), QStringLiteral("second"));
+        QVERIFY(!manager.environment.contains(existing));
+
+        // Unsetting and setting again within the window leaves the variable set
+        updates = {
+            {QProcessEnvironment(), {second}},
+            {environmentWith(second, QStringLiteral("again")), {}},
+            {environmentWith(first, QStringLiteral("4")), {}},
+            {QProcessEnvironment(), {first}},
+        };
+        runTogether(updates);
+        QCOMPARE(manager.calls, 2);
+        QCOMPARE(manager.environment.value(second), QStringLiteral("again"));
+        QVERIFY(!manager.environment.contains(first));
+
+        update(QProcessEnvironment(), {second});
+        QCOMPARE(manager.calls, 3);
+
+        connection.unregisterService(s_systemdService);
+        connection.unregisterObject(s_systemdPath);
+        QDBusConnection::disconnectFromBus(s_managerConnection);
+    }
+
+    void testDeferredDelivery()
+    {
+        const QString startupService = QStringLiteral("org.kde.Startup");
+        if (QDBusConnection::sessionBus().interface()->isServiceRegistered(startupService)) {
+            QSKIP("plasma-session is running");
+        }
+
+        // Started together, so both go out in the same update
+        QProcessEnvironment environment;
+        environment.insert(QStringLiteral("KLAUNCHENVIRONMENTTEST_DEFERRED"), QStringLiteral("deferred"));
+        auto deferredJob = new KUpdateLaunchEnvironmentJob(environment);
+        deferredJob->setDeferredDelivery(true);
+        QSignalSpy deferredSpy(deferredJob, &KUpdateLaunchEnvironmentJob::finished);
+        QProcessEnvironment lostEnvironment;
+        lostEnvironment.insert(QStringLiteral("KLAUNCHENVIRONMENTTEST_LOST"), QStringLiteral("lost"));
+        auto lostJob = new KUpdateLaunchEnvironmentJob(lostEnvironment);
+        QSignalSpy lostSpy(lostJob, &KUpdateLaunchEnvironmentJob::finished);
+        QVERIFY(deferredSpy.wait());
+        QTRY_COMPARE(lostSpy.count(), 1);
+
+        FakeStartup startup;
+        QDBusConnection connection = QDBusConnection::connectToBus(QDBusConnection::SessionBus, QStringLiteral("fakestartup"));
+        QVERIFY(connection.registerObject(QStringLiteral("/Startup"), &startup, QDBusConnection::ExportAllSlots));
+        QVERIFY(connection.registerService(startupService));
+
+        QTRY_COMPARE(startup.environment.value(QStringLiteral("KLAUNCHENVIRONMENTTEST_DEFERRED")), QStringLiteral("deferred"));
+        QVERIFY(!startup.environment.contains(QStringLiteral("KLAUNCHENVIRONMENTTEST_LOST")));
+
+        connection.unregisterService(startupService);
+        QDBusConnection::disconnectFromBus(QStringLiteral("fakestartup"));
+
+        update(QProcessEnvironment(), {QStringLiteral("KLAUNCHENVIRONMENTTEST_DEFERRED")});
+    }
+
+private:
+    static QProcessEnvironment environmentWith(const QString &name, const QString &value)
+    {
+        QProcessEnvironment environment;
+        environment.insert(name, value);
+        return environment;
+    }
+
+    // Starts a job for each of @p updates at once and waits until all of them finished
+    static void runTogether(const QList<std::pair<QProcessEnvironment, QStringList>> &updates)
+    {
+        std::vector<std::unique_ptr<QSignalSpy>> spies;
+        for (const auto &[environment, unsetVariables] : updates) {
+            auto job = new KUpdateLaunchEnvironmentJob(environment, unsetVariables);
+            spies.push_back(std::make_unique<QSignalSpy>(job, &KUpdateLaunchEnvironmentJob::finished));
+        }
+        for (const auto &spy : spies) {
+            QTRY_COMPARE(spy->count(), 1);
+        }
+    }
+
+    static void update(const QProcessEnvironment &environment, const QStringList &unsetVariables)
+    {
+        auto job = new KUpdateLaunchEnvironmentJob(environment, unsetVariables);
+        QSignalSpy finishedSpy(job, &KUpdateLaunchEnvironmentJob::finished);
+        QVERIFY(finishedSpy.wait());
+    }
+};
+
+QTEST_MAIN(KLaunchEnvironmentTest)
+
+#include "klaunchenvironmenttest.moc"
@@ -0,0 +1,85 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QTest>
+
+#include "klaunchenvironmentvalidation_p.h"
+
+// The checks KUpdateLaunchEnvironmentJob used before, to compare with
+static bool referenceIsSystemdApprovedValue(const QString &value)
+{
+    for (const char &it : value.toLatin1()) {
+        if (it == QLatin1Char('\n') || it == QLatin1Char('\t')) {
+            continue;
+        }
+        if (it > 0 && it < ' ') {
+            return false;
+        }
+        if (it == 127) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class KLaunchEnvironmentValidationBenchmark : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void benchmarkSystemdApprovedValue_data()
+    {
+        QTest::addColumn<QString>("value");
+        QTest::newRow("short") << QStringLiteral("/usr/bin");
+
+        QString paths;
+        while (paths.size() < 8192) {
+            paths += QStringLiteral("/home/user/.local/share/flatpak/exports/share:");
+        }
+        QTest::newRow("8K") << paths;
+    }
+
+    void benchmarkSystemdApprovedValue()
+    {
+        QFETCH(QString, value);
+        bool approved = false;
+        QBENCHMARK {
+            approved = KLaunchEnvironmentValidation::isSystemdApprovedValue(value);
+        }
+        QVERIFY(approved);
+    }
+
+    void benchmarkReferenceSystemdApprovedValue_data()
+    {
+        benchmarkSystemdApprovedValue_data();
+    }
+
+    void benchmarkReferenceSystemdApprovedValue()
+    {
+        QFETCH(QString, value);
+        bool approved = false;
+        QBENCHMARK {
+            approved = referenceIsSystemdApprovedValue(value);
+        }
+        QVERIFY(approved);
+    }
+
+    void benchmarkPosixName()
+    {
+        const QString name = QStringLiteral("XDG_CURRENT_DESKTOP_SESSION_NAME");
+        bool valid = false;
+        QBENCHMARK {
+            valid = KLaunchEnvironmentValidation::isPosixName(name);
+        }
+        QVERIFY(valid);
+    }
+};
+
+QTEST_GUILESS_MAIN(KLaunchEnvironmentValidationBenchmark)
+
+#include "klaunchenvironmentvalidationbenchmark.moc"
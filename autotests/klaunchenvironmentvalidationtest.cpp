@@ -0,0 +1,88 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QTest>
+
+#include "klaunchenvironmentvalidation_p.h"
+
+// The checks KUpdateLaunchEnvironmentJob used before, as reference
+static bool referenceIsSystemdApprovedValue(const QString &value)
+{
+    for (const char &it : value.toLatin1()) {
+        if (it == QLatin1Char('\n') || it == QLatin1Char('\t')) {
+            continue;
+        }
+        if (it > 0 && it < ' ') {
+            return false;
+        }
+        if (it == 127) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool isAsciiNameChar(char16_t c, bool first)
+{
+    return (c >= u'a' && c <= u'z') || (c >= u'A' && c <= u'Z') || c == u'_' || (!first && c >= u'0' && c <= u'9');
+}
+
+class KLaunchEnvironmentValidationTest : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testPosixName()
+    {
+        QVERIFY(!KLaunchEnvironmentValidation::isPosixName(QString()));
+        QVERIFY(KLaunchEnvironmentValidation::isPosixName(u"XDG_DATA_DIRS"));
+        QVERIFY(KLaunchEnvironmentValidation::isPosixName(u"_a1"));
+        QVERIFY(!KLaunchEnvironmentValidation::isPosixName(u"1a"));
+        QVERIFY(!KLaunchEnvironmentValidation::isPosixName(u"A-B"));
+        QVERIFY(!KLaunchEnvironmentValidation::isPosixName(u"A=B"));
+        // systemd only takes ASCII names
+        QVERIFY(!KLaunchEnvironmentValidation::isPosixName(u"éTé"));
+    }
+
+    // Every code unit as the first and as a later character of a name
+    void testPosixNameExhaustive()
+    {
+        for (uint c = 0; c <= 0xffff; ++c) {
+            const QChar ch(char16_t(c));
+            QCOMPARE(KLaunchEnvironmentValidation::isPosixName(QString(ch)), isAsciiNameChar(c, true));
+            QCOMPARE(KLaunchEnvironmentValidation::isPosixName(QStringLiteral("A") + ch + QStringLiteral("B")), isAsciiNameChar(c, false));
+        }
+    }
+
+    // The code units up to U+02FF, where the characters in question are, and a sample of the rest,
+    // at every position of the vectorized blocks and the remainder
+    void testSystemdApprovedValueSweep()
+    {
+        const QString filler = QStringLiteral("/usr/share:/usr/local/share:/opt");
+        QString value = filler + filler; // 66 characters, two remain after the blocks of 8
+
+        for (uint c = 0; c <= 0xffff; c += (c < 0x300 ? 1 : 251)) {
+            for (qsizetype position : {0, 1, 7, 8, 15, 16, 31, 63, 64, 65}) {
+                const QChar previous = value.at(position);
+                value[position] = QChar(char16_t(c));
+                if (KLaunchEnvironmentValidation::isSystemdApprovedValue(value) != referenceIsSystemdApprovedValue(value)) {
+                    QFAIL(qPrintable(QStringLiteral("Mismatch for U+%1 at %2").arg(c, 4, 16, QLatin1Char('0')).arg(position)));
+                }
+                value[position] = previous;
+            }
+        }
+
+        QVERIFY(KLaunchEnvironmentValidation::isSystemdApprovedValue(QString()));
+        QVERIFY(KLaunchEnvironmentValidation::isSystemdApprovedValue(u"a\tb\nc"));
+        QVERIFY(!KLaunchEnvironmentValidation::isSystemdApprovedValue(u"a\rb"));
+    }
+};
+
+QTEST_GUILESS_MAIN(KLaunchEnvironmentValidationTest)
+
+#include "klaunchenvironmentvalidationtest.moc"
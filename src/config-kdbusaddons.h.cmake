@@ -1 +1,2 @@
-#cmakedefine01 HAVE_X11
\ No newline at end of file
+#cmakedefine01 HAVE_X11
+#cmakedefine01 HAVE_TRACEPOINTS
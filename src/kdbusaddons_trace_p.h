@@ -0,0 +1,26 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+#ifndef KDBUSADDONS_TRACE_P_H
+#define KDBUSADDONS_TRACE_P_H
+
+#include "config-kdbusaddons.h"
+
+// Tracepoints are declared in kdbusaddons.tracepoints. Unless the library is
+// built with WITH_TRACEPOINTS, these macros expand to nothing.
+#if HAVE_TRACEPOINTS
+#include <private/qtrace_p.h>
+
+#include "kdbusaddons_tracepoints_p.h"
+
+#define KDBUSADDONS_TRACE(...) Q_TRACE(__VA_ARGS__)
+#define KDBUSADDONS_TRACE_SCOPE(...) Q_TRACE_SCOPE(__VA_ARGS__)
+#else
+#define KDBUSADDONS_TRACE(...)
+#define KDBUSADDONS_TRACE_SCOPE(...)
+#endif
+
+#endif
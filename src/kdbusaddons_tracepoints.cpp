@@ -0,0 +1,10 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.0-or-later
+*/
+
+// Instantiates the LTTng probes declared by the header generated with tracegen
+#define TRACEPOINT_CREATE_PROBES
+#define TRACEPOINT_DEFINE
+#include "kdbusaddons_tracepoints_p.h"
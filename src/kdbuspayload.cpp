@@ -0,0 +1,181 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "kdbuspayload_p.h"
+
+#include <QDBusConnection>
+#include <QDBusUnixFileDescriptor>
+
+#include "kdbusaddons_debug.h"
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A blob held in memory, owned by the mapping
+static KDBusPayload::Mapping copyPayload(QByteArray &&data)
+{
+    auto owner = std::make_shared<const QByteArray>(std::move(data));
+    return {owner, QByteArrayView(*owner)};
+}
+
+#ifdef Q_OS_LINUX
+static int createPayloadFile(const QByteArray &data)
+{
+    const int fd = memfd_create("kdbusaddons-payload", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        qCWarning(KDBUSADDONS_LOG) << "memfd_create failed:" << strerror(errno);
+        return -1;
+    }
+
+    const char *pos = data.constData();
+    qsizetype remaining = data.size();
+    while (remaining > 0) {
+        const ssize_t written = write(fd, pos, remaining);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(KDBUSADDONS_LOG) << "Writing payload failed:" << strerror(errno);
+            close(fd);
+            return -1;
+        }
+        pos += written;
+        remaining -= written;
+    }
+
+    // Guarantees the receiver that the data stays as it is while mapped
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+        qCWarning(KDBUSADDONS_LOG) << "Sealing payload failed:" << strerror(errno);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// Fallback for descriptors that could be changed or truncated under our feet, which would crash us while mapped
+static KDBusPayload::Mapping readUnsealedPayloadFile(int fd, qsizetype size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    qsizetype done = 0;
+    while (done < size) {
+        const ssize_t count = pread(fd, data.data() + done, size - done, done);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qCWarning(KDBUSADDONS_LOG) << "Reading payload failed:" << strerror(errno);
+            return {};
+        }
+        if (count == 0) {
+            break;
+        }
+        done += count;
+    }
+    data.truncate(done);
+    return copyPayload(std::move(data));
+}
+
+static KDBusPayload::Mapping mapPayloadFile(int fd, qsizetype maxSize)
+{
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        qCWarning(KDBUSADDONS_LOG) << "Cannot stat payload:" << strerror(errno);
+        return {};
+    }
+    // Pipes, sockets and devices have no size to go by
+    if (!S_ISREG(info.st_mode)) {
+        qCWarning(KDBUSADDONS_LOG) << "Rejecting payload that is not a regular file";
+        return {};
+    }
+    if (info.st_size < 0 || info.st_size > maxSize) {
+        qCWarning(KDBUSADDONS_LOG) << "Rejecting payload of" << info.st_size << "bytes, the limit is" << maxSize;
+        return {};
+    }
+    if (info.st_size == 0) {
+        return copyPayload(QByteArray(""));
+    }
+    const qsizetype size = info.st_size;
+
+    const int seals = fcntl(fd, F_GET_SEALS);
+    if (seals < 0 || (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)) {
+        return readUnsealedPayloadFile(fd, size);
+    }
+
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        qCWarning(KDBUSADDONS_LOG) << "Cannot map payload:" << strerror(errno);
+        return {};
+    }
+
+    // The mapping lives as long as its owner is referenced
+    std::shared_ptr<const void> owner(map, [size](const void *map) {
+        munmap(const_cast<void *>(map), size);
+    });
+    return {owner, QByteArrayView(static_cast<const char *>(map), size)};
+}
+#endif
+
+QDBusVariant KDBusPayload::pack(const QByteArray &data, const QDBusConnection &connection, qsizetype inlineThreshold)
+{
+#ifdef Q_OS_LINUX
+    if (data.size() > inlineThreshold && (connection.connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing)) {
+        const int fd = createPayloadFile(data);
+        if (fd >= 0) {
+            // QDBusUnixFileDescriptor keeps its own duplicate
+            const QDBusUnixFileDescriptor descriptor(fd);
+            close(fd);
+            return QDBusVariant(QVariant::fromValue(descriptor));
+        }
+    }
+#else
+    Q_UNUSED(connection);
+    Q_UNUSED(inlineThreshold);
+#endif
+    return QDBusVariant(data);
+}
+
+KDBusPayload::Mapping KDBusPayload::map(const QDBusVariant &payload, qsizetype maxSize)
+{
+    const QVariant value = payload.variant();
+    if (value.metaType() == QMetaType::fromType<QByteArray>()) {
+        return copyPayload(value.toByteArray());
+    }
+#ifdef Q_OS_LINUX
+    if (value.metaType() == QMetaType::fromType<QDBusUnixFileDescriptor>()) {
+        const auto descriptor = value.value<QDBusUnixFileDescriptor>();
+        if (descriptor.isValid()) {
+            return mapPayloadFile(descriptor.fileDescriptor(), maxSize);
+        }
+    }
+#else
+    Q_UNUSED(maxSize);
+#endif
+    qCWarning(KDBUSADDONS_LOG) << "Unexpected payload type" << value.metaType().name();
+    return {};
+}
+
+QByteArray KDBusPayload::unpack(const QDBusVariant &payload, qsizetype maxSize)
+{
+    if (payload.variant().metaType() == QMetaType::fromType<QByteArray>()) {
+        return payload.variant().toByteArray();
+    }
+
+    const Mapping mapping = map(payload, maxSize);
+    if (!mapping.owner) {
+        return QByteArray();
+    }
+    // Detach from a mapping before it goes away
+    return mapping.data.toByteArray();
+}
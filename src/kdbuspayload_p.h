@@ -0,0 +1,56 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KDBUSPAYLOAD_P_H
+#define KDBUSPAYLOAD_P_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QDBusVariant>
+
+#include <memory>
+
+class QDBusConnection;
+
+/*
+ * Helpers for passing blobs of arbitrary size over D-Bus as a variant.
+ *
+ * Small blobs are sent inline as "ay". Larger ones are written to an
+ * anonymous memory file whose descriptor is sent as "h" instead, so the
+ * bus daemon does not have to copy the data around. The file is sealed,
+ * so the receiver can map it without the sender changing it meanwhile.
+ * Files that are not sealed against writing and shrinking are read instead.
+ */
+namespace KDBusPayload
+{
+/* Blobs larger than this are passed as a file descriptor if the connection allows it. */
+constexpr qsizetype defaultInlineThreshold = 64 * 1024;
+
+QDBusVariant pack(const QByteArray &data, const QDBusConnection &connection, qsizetype inlineThreshold = defaultInlineThreshold);
+
+/* Files larger than this are rejected by the receiver. */
+constexpr qsizetype defaultMaxSize = 256 * 1024 * 1024;
+
+/* A blob and what keeps it valid, a null owner if there is no blob. */
+struct Mapping {
+    std::shared_ptr<const void> owner;
+    QByteArrayView data;
+};
+
+/*
+ * Returns the blob held by @p payload, or a null owner if it holds neither "ay"
+ * nor a regular file as "h", or a file larger than @p maxSize. A sealed file is
+ * mapped, and stays mapped for as long as the owner is referenced.
+ */
+Mapping map(const QDBusVariant &payload, qsizetype maxSize = defaultMaxSize);
+
+/* Same as map(), but returns a copy of the blob, or a null QByteArray. */
+QByteArray unpack(const QDBusVariant &payload, qsizetype maxSize = defaultMaxSize);
+}
+
+#endif
@@ -11,14 +11,20 @@
 #include "kdbusservice.h"
 
 #include <QCoreApplication>
+#include <QCryptographicHash>
 #include <QDebug>
+#include <QSet>
+
+#include <chrono>
 
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusReply>
+#include <QDBusServiceWatcher>
 
 #include "FreeDesktopApplpicationIface.h"
 #include "KDBusServiceIface.h"
+#include "kdbuspayload_p.h"
 
 #include "config-kdbusaddons.h"
 
@@ -27,8 +33,18 @@
 #endif
 
 #include "kdbusaddons_debug.h"
-#include "kdbusservice_adaptor.h"
-#include "kdbusserviceextensions_adaptor.h"
+#include "kdbusaddons_latency_debug.h"
+#include "kdbusaddons_trace_p.h"
+#include "kdbusservicedispatcher_p.h"
+
+static qint64 monotonicNow()
+{
+    // steady_clock is the system-wide monotonic clock, so timestamps can be compared across processes
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Applications link to us, so this is taken as the process starts up
+static const qint64 s_processStartTime = monotonicNow();
 
 class KDBusServicePrivate
 {
@@ -58,27 +74,230 @@ public:
         return reversedDomain + app->applicationName();
     }
 
-    static void handlePlatformData(const QVariantMap &platformData)
+    static QString shardPrefix()
+    {
+        return QStringLiteral(".shard_");
+    }
+
+    static QString shardSuffix(const QString &routingKey)
+    {
+        // 64 bits of the hash are plenty to keep the shards of one application apart.
+        // The prefix also keeps the name element from starting with a digit, which D-Bus forbids.
+        const QByteArray hash = QCryptographicHash::hash(routingKey.toUtf8(), QCryptographicHash::Sha256);
+        return shardPrefix() + QString::fromLatin1(hash.left(8).toHex());
+    }
+
+    // Called once the request carrying the platform data has been handled.
+    void reportLaunchLatency(KDBusService *q)
+    {
+        if (launchTimestamp <= 0) {
+            return;
+        }
+
+        const qint64 latencyUsec = (monotonicNow() - launchTimestamp) / 1000;
+        launchTimestamp = 0;
+        if (latencyUsec < 0) {
+            // Not a time taken from our clock
+            return;
+        }
+        qCInfo(KDBUSADDONS_LATENCY_LOG) << "Launch from pid" << launcherPid << "handled after" << latencyUsec << "us";
+        Q_EMIT q->launchLatencyMeasured(launcherPid, latencyUsec);
+    }
+
+    void leavePreload(KDBusService *q)
+    {
+        if (preloaded) {
+            preloaded = false;
+            Q_EMIT q->preloadActivated();
+        }
+    }
+
+    void handlePlatformData(const KDBusServicePlatformData &platformData)
     {
+        launchTimestamp = platformData.launchTimestamp;
+        launcherPid = platformData.launcherPid;
+
         #if HAVE_X11
         if (QX11Info::isPlatformX11()) {
-            QByteArray desktopStartupId = platformData.value(QStringLiteral("desktop-startup-id")).toByteArray();
-            if (!desktopStartupId.isEmpty()) {
-                QX11Info::setNextStartupId(desktopStartupId);
+            if (!platformData.desktopStartupId.isEmpty()) {
+                QX11Info::setNextStartupId(platformData.desktopStartupId);
             }
         }
         #endif
 
-        const auto xdgActivationToken = platformData.value(QLatin1String("activation-token")).toByteArray();
-        if (!xdgActivationToken.isEmpty()) {
-            qputenv("XDG_ACTIVATION_TOKEN", xdgActivationToken);
+        if (!platformData.activationToken.isEmpty()) {
+            qputenv("XDG_ACTIVATION_TOKEN", platformData.activationToken);
+        }
+    }
+
+    // Names on the bus belonging to this application, i.e. generateServiceName() followed by a shard or instance suffix.
+    // Filled on first use and then kept up to date from NameOwnerChanged.
+    const QSet<QString> &applicationNames(const QObject *context)
+    {
+        if (applicationNamesWatched) {
+            return applicationNames_;
+        }
+
+        QDBusConnectionInterface *bus = nullptr;
+        if (!QDBusConnection::sessionBus().isConnected() || !(bus = QDBusConnection::sessionBus().interface())) {
+            return applicationNames_;
+        }
+
+        const QString base = generateServiceName();
+        QObject::connect(bus,
+                         &QDBusConnectionInterface::serviceOwnerChanged,
+                         context,
+                         [this, base](const QString &name, const QString &oldOwner, const QString &newOwner) {
+                             Q_UNUSED(oldOwner);
+                             if (!isApplicationName(name, base)) {
+                                 return;
+                             }
+                             if (newOwner.isEmpty()) {
+                                 applicationNames_.remove(name);
+                             } else {
+                                 applicationNames_.insert(name);
+                             }
+                         });
+        applicationNamesWatched = true;
+
+        const QStringList names = bus->registeredServiceNames().value();
+        for (const QString &name : names) {
+            if (isApplicationName(name, base)) {
+                applicationNames_.insert(name);
+            }
+        }
+        return applicationNames_;
+    }
+
+    // Length of the shard suffix shardSuffix() generates at the start of @p suffix, or 0 if it does not start with one.
+    static qsizetype shardSuffixLength(QStringView suffix)
+    {
+        const qsizetype prefixLength = shardPrefix().size();
+        const qsizetype length = prefixLength + 16;
+        if (suffix.size() < length || !suffix.startsWith(shardPrefix())) {
+            return 0;
+        }
+        for (const QChar c : suffix.mid(prefixLength, 16)) {
+            if (!c.isDigit() && (c < QLatin1Char('a') || c > QLatin1Char('f'))) {
+                return 0;
+            }
+        }
+        return length;
+    }
+
+    // Whether @p suffix is empty or one of the suffixes Multiple adds to the service name.
+    static bool isInstanceSuffix(QStringView suffix)
+    {
+        if (suffix.isEmpty() || suffix.startsWith(QLatin1String(".kdbus-"))) {
+            return true;
+        }
+        if (suffix.size() < 2 || suffix.front() != QLatin1Char('-')) {
+            return false;
+        }
+        for (const QChar c : suffix.mid(1)) {
+            if (!c.isDigit()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether @p name is the Unique name @p base or a Multiple name derived from it.
+    static bool isInstanceName(const QString &name, const QString &base)
+    {
+        return name.startsWith(base) && isInstanceSuffix(QStringView(name).mid(base.size()));
+    }
+
+    // Whether @p name is @p base, optionally followed by a shard suffix, followed by an instance suffix.
+    // Unlike a plain prefix match this leaves out other applications, like org.kde.apple for org.kde.app.
+    static bool isApplicationName(const QString &name, const QString &base)
+    {
+        if (!name.startsWith(base)) {
+            return false;
         }
+        const QStringView suffix = QStringView(name).mid(base.size());
+        return isInstanceSuffix(suffix.mid(shardSuffixLength(suffix)));
     }
 
     bool registered;
+    bool standby = false;
+    bool preloaded = false;
     QString serviceName;
+    QString routingKey;
     QString errorMessage;
     int exitValue;
+    int load = 0;
+    int capacity = 0;
+    qint64 launchTimestamp = 0;
+    qint64 launcherPid = 0;
+    QByteArray handOverState;
+    QByteArray handedOverState;
+    KDBusServiceDispatcher *dispatcher = nullptr;
+
+private:
+    QSet<QString> applicationNames_;
+    bool applicationNamesWatched = false;
+};
+
+static const QLatin1String s_aggregatorPath("/org/kde/KDBusService/LaunchAggregator");
+static const QLatin1String s_aggregatorInterface("org.kde.KDBusService.LaunchAggregator");
+
+// The error an instance that is being replaced answers activation requests with
+static const QLatin1String s_handedOverError("org.kde.KDBusService.Error.HandedOver");
+
+// How often a launch is forwarded again after the instance it went to handed it back
+static const int s_maxForwardAttempts = 3;
+
+// How long the first of several concurrently started processes collects the launches of the others
+static int aggregationWindow()
+{
+    bool ok = false;
+    const int window = qEnvironmentVariableIntValue("KDBUSSERVICE_AGGREGATION_WINDOW", &ok);
+    return ok && window >= 0 ? window : 50;
+}
+
+// Lets processes started at the same time join the launch forwarded by the first one,
+// see KDBusService::AggregateLaunches. The collected calls are answered once the
+// running instance has handled the batch.
+class LaunchAggregator : public QDBusVirtualObject
+{
+    Q_OBJECT
+public:
+    using QDBusVirtualObject::QDBusVirtualObject;
+
+    QString introspect(const QString &path) const override
+    {
+        Q_UNUSED(path);
+        return QStringLiteral(
+            "  <interface name=\"org.kde.KDBusService.LaunchAggregator\">\n"
+            "    <method name=\"Join\">\n"
+            "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"QVariantMap\"/>\n"
+            "      <arg name=\"arguments\" type=\"as\" direction=\"in\"/>\n"
+            "      <arg name=\"working-dir\" type=\"s\" direction=\"in\"/>\n"
+            "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+            "      <arg name=\"exit-status\" type=\"i\" direction=\"out\"/>\n"
+            "    </method>\n"
+            "  </interface>\n");
+    }
+
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override
+    {
+        if (message.member() != QLatin1String("Join")) {
+            return false;
+        }
+        if (message.signature() != QLatin1String("assa{sv}")) {
+            connection.send(message.createErrorReply(QDBusError::InvalidSignature, QStringLiteral("Join expects arguments of type \"assa{sv}\"")));
+            return true;
+        }
+
+        const QVariantList arguments = message.arguments();
+        launches.append(KDBusServiceLaunch{arguments.at(0).toStringList(), arguments.at(1).toString(), qdbus_cast<QVariantMap>(arguments.at(2))});
+        joined.append(message);
+        return true;
+    }
+
+    KDBusServiceLaunchList launches;
+    QList<QDBusMessage> joined;
 };
 
 // Wraps a serviceName registration.
@@ -107,11 +326,13 @@ public:
 
     void run()
     {
+        KDBUSADDONS_TRACE_SCOPE(KDBusService_registration, d->serviceName);
+
         if (bus) {
             registerOnBus();
         }
 
-        if (!d->registered && ((options & KDBusService::NoExitOnFailure) == 0)) {
+        if (!d->registered && !d->standby && ((options & KDBusService::NoExitOnFailure) == 0)) {
             qCCritical(KDBUSADDONS_LOG) << qPrintable(d->errorMessage);
             exit(1);
         }
@@ -125,6 +346,11 @@ private:
         objectPath.replace(QLatin1Char('.'), QLatin1Char('/'));
         objectPath.replace(QLatin1Char('-'), QLatin1Char('_')); // see spec change at https://bugs.freedesktop.org/show_bug.cgi?id=95129
 
+        if (!d->routingKey.isEmpty()) {
+            d->serviceName += KDBusServicePrivate::shardSuffix(d->routingKey);
+        }
+        baseServiceName = d->serviceName;
+
         if (options & KDBusService::Multiple) {
             const bool inSandbox = QFileInfo::exists(QStringLiteral("/.flatpak-info"));
             if (inSandbox) {
@@ -138,6 +364,15 @@ private:
 
     void registerOnBus()
     {
+        if (registerObjects()) {
+            attemptRegistration();
+        }
+    }
+
+    bool registerObjects()
+    {
+        KDBUSADDONS_TRACE_SCOPE(KDBusService_registerObjects, objectPath);
+
         auto bus = QDBusConnection::sessionBus();
         bool objectRegistered = false;
         objectRegistered = bus.registerObject(QStringLiteral("/MainApplication"),
@@ -147,22 +382,271 @@ private:
                                                   | QDBusConnection::ExportAdaptors);
         if (!objectRegistered) {
             qCWarning(KDBUSADDONS_LOG) << "Failed to register /MainApplication on DBus";
-            return;
+            return false;
         }
 
-        objectRegistered = bus.registerObject(objectPath, s, QDBusConnection::ExportAdaptors);
+        objectRegistered = bus.registerVirtualObject(objectPath, d->dispatcher);
         if (!objectRegistered) {
             qCWarning(KDBUSADDONS_LOG) << "Failed to register" << objectPath << "on DBus";
+            return false;
+        }
+
+        return true;
+    }
+
+    // Hands this launch over to the instance owning @p service and exits.
+    // Only returns if that failed, with the error message.
+    QString forwardActivation(const QString &service)
+    {
+        KDBUSADDONS_TRACE_SCOPE(KDBusService_forwardActivation, service);
+
+        // An instance that is being replaced hands the launch back, which then
+        // goes to the instance replacing it once that one owns the name
+        QDBusError error;
+        for (int attempt = 0; attempt < s_maxForwardAttempts; ++attempt) {
+            const QDBusReply<QString> owner = bus->serviceOwner(service);
+            if (!owner.isValid()) {
+                return owner.error().message();
+            }
+
+            error = sendActivation(owner.value());
+            if (error.name() != s_handedOverError) {
+                break;
+            }
+            qCDebug(KDBUSADDONS_LOG) << owner.value() << "is being replaced, waiting for the new owner of" << service;
+            if (!waitForNewOwner(service, owner.value())) {
+                break;
+            }
+        }
+        return error.message();
+    }
+
+    // Forwards this launch to @p target and exits. Only returns if that failed, with the error.
+    QDBusError sendActivation(const QString &target)
+    {
+        const QVariantMap platform_data = platformData();
+
+        if (QCoreApplication::arguments().count() > 1) {
+            OrgKdeKDBusServiceInterface iface(target, objectPath, QDBusConnection::sessionBus());
+            iface.setTimeout(5 * 60 * 1000); // Application can take time to answer
+            QDBusReply<int> reply = iface.CommandLine(QCoreApplication::arguments(), QDir::currentPath(), platform_data);
+            if (reply.isValid()) {
+                exit(reply.value());
+            }
+            return reply.error();
+        } else {
+            OrgFreedesktopApplicationInterface iface(target, objectPath, QDBusConnection::sessionBus());
+            iface.setTimeout(5 * 60 * 1000); // Application can take time to answer
+            QDBusReply<void> reply = iface.Activate(platform_data);
+            if (reply.isValid()) {
+                exit(0);
+            }
+            return reply.error();
+        }
+    }
+
+    // Waits until @p service is owned by another connection than @p previousOwner.
+    // Returns false if that did not happen in time, or if we got the name ourselves.
+    bool waitForNewOwner(const QString &service, const QString &previousOwner)
+    {
+        QEventLoop loop;
+        QString newOwner;
+        QDBusServiceWatcher watcher(service, QDBusConnection::sessionBus(), QDBusServiceWatcher::WatchForOwnerChange);
+        connect(&watcher, &QDBusServiceWatcher::serviceOwnerChanged, &loop, [&loop, &newOwner](const QString &, const QString &, const QString &owner) {
+            if (!owner.isEmpty()) {
+                newOwner = owner;
+                loop.quit();
+            }
+        });
+
+        // The owner may have changed before we started watching
+        const QDBusReply<QString> owner = bus->serviceOwner(service);
+        if (owner.isValid() && owner.value() != previousOwner) {
+            newOwner = owner.value();
+        } else {
+            QTimer::singleShot(8000, &loop, &QEventLoop::quit);
+            loop.exec();
+        }
+
+        return !newOwner.isEmpty() && newOwner != previousOwner && newOwner != QDBusConnection::sessionBus().baseService();
+    }
+
+    // The platform data sent along with this launch when forwarding it
+    static QVariantMap platformData()
+    {
+        QVariantMap platform_data;
+#if HAVE_X11
+        if (QX11Info::isPlatformX11()) {
+            QString startupId = QString::fromUtf8(qgetenv("DESKTOP_STARTUP_ID"));
+            if (startupId.isEmpty()) {
+                startupId = QString::fromUtf8(QX11Info::nextStartupId());
+            }
+            if (!startupId.isEmpty()) {
+                platform_data.insert(QStringLiteral("desktop-startup-id"), startupId);
+            }
+        }
+#endif
+
+        if (qEnvironmentVariableIsSet("XDG_ACTIVATION_TOKEN")) {
+            platform_data.insert(QStringLiteral("activation-token"), qgetenv("XDG_ACTIVATION_TOKEN"));
+        }
+
+        // Lets the running instance measure the latency the user experiences
+        platform_data.insert(QStringLiteral("kde-launch-timestamp"), s_processStartTime);
+        platform_data.insert(QStringLiteral("kde-launch-pid"), QCoreApplication::applicationPid());
+
+        return platform_data;
+    }
+
+    // This launch as an element of a CommandLineBatch call
+    static KDBusServiceLaunch launch()
+    {
+        // Like in forwardActivation(), no arguments means Activate
+        const QStringList arguments = QCoreApplication::arguments().count() > 1 ? QCoreApplication::arguments() : QStringList();
+        return KDBusServiceLaunch{arguments, QDir::currentPath(), platformData()};
+    }
+
+    // Forwards this launch together with the ones of concurrently started processes,
+    // and exits. Only returns if that failed, the launch then needs forwarding on its own.
+    void forwardAggregatedActivation()
+    {
+        auto connection = QDBusConnection::sessionBus();
+        const QString rendezvous = d->serviceName + QLatin1String(".LaunchAggregator");
+
+        if (bus->registerService(rendezvous, QDBusConnectionInterface::DontQueueService) != QDBusConnectionInterface::ServiceRegistered) {
+            // Another process is collecting launches already, join it
+            const KDBusServiceLaunch ownLaunch = launch();
+            QDBusMessage message = QDBusMessage::createMethodCall(rendezvous, s_aggregatorPath, s_aggregatorInterface, QStringLiteral("Join"));
+            message << ownLaunch.arguments << ownLaunch.workingDirectory << ownLaunch.platformData;
+            const QDBusReply<int> reply = connection.call(message, QDBus::Block, 5 * 60 * 1000); // Application can take time to answer
+            if (reply.isValid()) {
+                exit(reply.value());
+            }
+            qCDebug(KDBUSADDONS_LOG) << "Could not join the launch forwarded by" << rendezvous << reply.error().message();
+            return;
+        }
+
+        LaunchAggregator aggregator;
+        connection.registerVirtualObject(s_aggregatorPath, &aggregator);
+        QEventLoop collectLoop;
+        QTimer::singleShot(aggregationWindow(), &collectLoop, &QEventLoop::quit);
+        collectLoop.exec();
+        // Processes started from now on will collect launches among themselves
+        connection.unregisterObject(s_aggregatorPath);
+        bus->unregisterService(rendezvous);
+
+        KDBusServiceLaunchList launches = aggregator.launches;
+        launches.prepend(launch());
+
+        OrgKdeKDBusServiceInterface iface(d->serviceName, objectPath, connection);
+        iface.setTimeout(5 * 60 * 1000); // Application can take time to answer
+        const QDBusReply<QList<int>> reply = iface.CommandLineBatch(launches);
+        const QList<int> exitValues = reply.value();
+
+        if (reply.isValid() && exitValues.size() == launches.size()) {
+            qCDebug(KDBUSADDONS_LOG) << "Forwarded" << launches.size() << "launches to" << d->serviceName;
+            QStringList joiners;
+            for (int i = 0; i < aggregator.joined.size(); ++i) {
+                connection.send(aggregator.joined.at(i).createReply(exitValues.at(i + 1)));
+                joiners.append(aggregator.joined.at(i).service());
+            }
+            // Exiting right away could drop the replies still queued for sending
+            waitForExit(joiners);
+            exit(exitValues.first());
+        }
+
+        // Most likely a running instance without support for batches. Have every process forward its own launch.
+        qCDebug(KDBUSADDONS_LOG) << "Could not forward" << launches.size() << "launches to" << d->serviceName << reply.error().message();
+        for (const QDBusMessage &message : std::as_const(aggregator.joined)) {
+            connection.send(message.createErrorReply(QDBusError::NotSupported, QStringLiteral("The launch could not be forwarded as part of a batch")));
+        }
+    }
+
+    // Waits until the processes owning the unique names @p joiners left the bus, which
+    // they do once they got our reply. QDBusConnection offers no way to flush the replies.
+    void waitForExit(const QStringList &joiners)
+    {
+        if (joiners.isEmpty()) {
+            return;
+        }
+
+        QEventLoop loop;
+        QSet<QString> remaining(joiners.cbegin(), joiners.cend());
+        QDBusServiceWatcher watcher(QString(), QDBusConnection::sessionBus(), QDBusServiceWatcher::WatchForUnregistration);
+        watcher.setWatchedServices(joiners);
+        connect(&watcher, &QDBusServiceWatcher::serviceUnregistered, &loop, [&loop, &remaining](const QString &name) {
+            remaining.remove(name);
+            if (remaining.isEmpty()) {
+                loop.quit();
+            }
+        });
+
+        // Some may be gone before we started watching
+        for (const QString &name : joiners) {
+            if (!bus->isServiceRegistered(name)) {
+                remaining.remove(name);
+            }
+        }
+        if (remaining.isEmpty()) {
             return;
         }
 
-        attemptRegistration();
+        QTimer::singleShot(5000, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+
+    // Returns the running instance with the most headroom according to the load
+    // hints they publish, or an empty string if all of them are saturated.
+    QString leastLoadedInstance()
+    {
+        QStringList candidates;
+        QList<QDBusPendingReply<int, int>> replies;
+        for (const QString &name : d->applicationNames(s)) {
+            if (!KDBusServicePrivate::isInstanceName(name, baseServiceName)) {
+                continue;
+            }
+            OrgKdeKDBusServiceInterface iface(name, objectPath, QDBusConnection::sessionBus());
+            iface.setTimeout(500); // a busy instance is not a good candidate anyway
+            candidates.append(name);
+            replies.append(iface.LoadHint());
+        }
+
+        QString best;
+        qint64 bestLoad = 0;
+        qint64 bestCapacity = 1;
+        for (int i = 0; i < replies.size(); ++i) {
+            QDBusPendingReply<int, int> &reply = replies[i];
+            reply.waitForFinished();
+            if (!reply.isValid()) {
+                continue;
+            }
+            const qint64 load = reply.argumentAt<0>();
+            const qint64 capacity = reply.argumentAt<1>();
+            if (capacity <= 0 || load >= capacity) {
+                continue;
+            }
+            // Compare load / capacity without going through floating point.
+            if (best.isEmpty() || load * bestCapacity < bestLoad * capacity) {
+                best = candidates.at(i);
+                bestLoad = load;
+                bestCapacity = capacity;
+            }
+        }
+        return best;
     }
 
     void attemptRegistration()
     {
         Q_ASSERT(!d->registered);
 
+        if ((options & KDBusService::Multiple) && (options & KDBusService::LoadBalanced)) {
+            const QString instance = leastLoadedInstance();
+            if (!instance.isEmpty()) {
+                const QString error = forwardActivation(instance);
+                qCDebug(KDBUSADDONS_LOG) << "Could not hand launch over to" << instance << error;
+            }
+        }
+
         auto queueOption = QDBusConnectionInterface::DontQueueService;
 
         if (options & KDBusService::Unique) {
@@ -185,61 +669,63 @@ private:
             });
         }
 
+        KDBUSADDONS_TRACE(KDBusService_requestName_entry, d->serviceName);
         d->registered = (bus->registerService(d->serviceName, queueOption) == QDBusConnectionInterface::ServiceRegistered);
+        KDBUSADDONS_TRACE(KDBusService_requestName_exit, d->registered);
 
         if (d->registered) {
+            d->preloaded = options.testFlag(KDBusService::Preload);
             return;
         }
 
-        if (options & KDBusService::Replace) {
-            auto message = QDBusMessage::createMethodCall(d->serviceName,
-                                                          QStringLiteral("/MainApplication"),
-                                                          QStringLiteral("org.qtproject.Qt.QCoreApplication"),
-                                                          QStringLiteral("quit"));
-            QDBusConnection::sessionBus().asyncCall(message);
-            waitForRegistration();
-        } else if (options & KDBusService::Unique) {
-            // Already running so it's ok!
-            QVariantMap platform_data;
-#if HAVE_X11
-            if (QX11Info::isPlatformX11()) {
-                QString startupId = QString::fromUtf8(qgetenv("DESKTOP_STARTUP_ID"));
-                if (startupId.isEmpty()) {
-                    startupId = QString::fromUtf8(QX11Info::nextStartupId());
-                }
-                if (!startupId.isEmpty()) {
-                    platform_data.insert(QStringLiteral("desktop-startup-id"), startupId);
-                }
+        if ((options & KDBusService::Unique) && (options & KDBusService::Preload)) {
+            // Activating the running instance would bring up its window,
+            // which is the opposite of what preloading is meant for.
+            bus->unregisterService(d->serviceName);
+            if ((options & KDBusService::NoExitOnFailure) == 0) {
+                exit(0);
             }
-#endif
+            d->errorMessage = QLatin1String("Not preloading '") + d->serviceName + QLatin1String("', it is running already.");
+            return;
+        }
 
-            if (qEnvironmentVariableIsSet("XDG_ACTIVATION_TOKEN")) {
-                platform_data.insert(QStringLiteral("activation-token"), qgetenv("XDG_ACTIVATION_TOKEN"));
+        if (options & KDBusService::Replace) {
+            if (!requestHandOver()) {
+                auto message = QDBusMessage::createMethodCall(d->serviceName,
+                                                              QStringLiteral("/MainApplication"),
+                                                              QStringLiteral("org.qtproject.Qt.QCoreApplication"),
+                                                              QStringLiteral("quit"));
+                QDBusConnection::sessionBus().asyncCall(message);
             }
-
-            if (QCoreApplication::arguments().count() > 1) {
-                OrgKdeKDBusServiceInterface iface(d->serviceName, objectPath, QDBusConnection::sessionBus());
-                iface.setTimeout(5 * 60 * 1000); // Application can take time to answer
-                QDBusReply<int> reply = iface.CommandLine(QCoreApplication::arguments(), QDir::currentPath(), platform_data);
-                if (reply.isValid()) {
-                    exit(reply.value());
-                } else {
-                    d->errorMessage = reply.error().message();
-                }
-            } else {
-                OrgFreedesktopApplicationInterface iface(d->serviceName, objectPath, QDBusConnection::sessionBus());
-                iface.setTimeout(5 * 60 * 1000); // Application can take time to answer
-                QDBusReply<void> reply = iface.Activate(platform_data);
-                if (reply.isValid()) {
-                    exit(0);
-                } else {
-                    d->errorMessage = reply.error().message();
+            waitForRegistration();
+        } else if ((options & KDBusService::Unique) && (options & KDBusService::Standby)) {
+            // Stay in the queue for the name, the bus will hand it over as
+            // soon as the running instance drops off.
+            d->standby = true;
+            KDBusServicePrivate *priv = d;
+            KDBusService *service = s;
+            connect(bus, &QDBusConnectionInterface::serviceRegistered, s, [priv, service](const QString &name) {
+                if (!priv->standby || name != priv->serviceName) {
+                    return;
                 }
+
+                priv->standby = false;
+                priv->registered = true;
+                Q_EMIT service->promoted();
+            });
+            return;
+        } else if (options & KDBusService::Unique) {
+            // Already running so it's ok!
+            if (options & KDBusService::AggregateLaunches) {
+                forwardAggregatedActivation();
             }
+            d->errorMessage = forwardActivation(d->serviceName);
 
             // service did not respond in a valid way....
             // let's wait to see if our queued registration finishes perhaps.
-            waitForRegistration();
+            if (!d->registered) {
+                waitForRegistration();
+            }
         }
 
         if (!d->registered) { // either multi service or failed to reclaim name
@@ -247,8 +733,26 @@ private:
         }
     }
 
+    // Asks the running instance to pass on its state and make way for us.
+    // Returns false if it doesn't implement the hand-over protocol.
+    bool requestHandOver()
+    {
+        OrgKdeKDBusServiceInterface iface(d->serviceName, objectPath, QDBusConnection::sessionBus());
+        iface.setTimeout(30 * 1000); // Application may need a moment to serialize its state
+        QDBusReply<QDBusVariant> reply = iface.HandOver();
+        if (!reply.isValid()) {
+            qCDebug(KDBUSADDONS_LOG) << "Running instance did not hand over its state:" << reply.error().message();
+            return false;
+        }
+
+        d->handedOverState = KDBusPayload::unpack(reply.value());
+        return true;
+    }
+
     void waitForRegistration()
     {
+        KDBUSADDONS_TRACE_SCOPE(KDBusService_waitForRegistration);
+
         QTimer quitTimer;
         // We have to wait for the other application to quit completely which could take a while
         quitTimer.start(8000);
@@ -262,17 +766,31 @@ private:
     KDBusService::StartupOptions options;
     QEventLoop registrationLoop;
     QString objectPath;
+    QString baseServiceName;
 };
 
 KDBusService::KDBusService(StartupOptions options, QObject *parent)
+    : KDBusService(options, QString(), parent)
+{
+}
+
+KDBusService::KDBusService(StartupOptions options, const QString &routingKey, QObject *parent)
     : QObject(parent)
     , d(new KDBusServicePrivate)
 {
-    new KDBusServiceAdaptor(this);
-    new KDBusServiceExtensionsAdaptor(this);
+    d->routingKey = routingKey;
+
+    d->dispatcher = new KDBusServiceDispatcher(this);
 
     Registration registration(this, d.get(), options);
     registration.run();
+
+    if (!d->handedOverState.isEmpty()) {
+        auto stateSignal = [this]() {
+            Q_EMIT stateHandedOver(d->handedOverState);
+        };
+        QMetaObject::invokeMethod(this, stateSignal, Qt::QueuedConnection);
+    }
 }
 
 KDBusService::~KDBusService() = default;
@@ -282,6 +800,16 @@ bool KDBusService::isRegistered() const
     return d->registered;
 }
 
+bool KDBusService::isStandby() const
+{
+    return d->standby;
+}
+
+bool KDBusService::isPreloaded() const
+{
+    return d->preloaded;
+}
+
 QString KDBusService::errorMessage() const
 {
     return d->errorMessage;
@@ -292,11 +820,70 @@ void KDBusService::setExitValue(int value)
     d->exitValue = value;
 }
 
+void KDBusService::setHandOverState(const QByteArray &state)
+{
+    d->handOverState = state;
+}
+
+QByteArray KDBusService::handedOverState() const
+{
+    return d->handedOverState;
+}
+
 QString KDBusService::serviceName() const
 {
     return d->serviceName;
 }
 
+QString KDBusService::routingKey() const
+{
+    return d->routingKey;
+}
+
+QStringList KDBusService::runningShards() const
+{
+    const QString base = d->generateServiceName();
+    QStringList shards;
+    for (const QString &name : d->applicationNames(this)) {
+        if (KDBusServicePrivate::shardSuffixLength(QStringView(name).mid(base.size())) > 0) {
+            shards.append(name);
+        }
+    }
+    return shards;
+}
+
+QStringList KDBusService::runningInstances() const
+{
+    QString base = d->generateServiceName();
+    if (!d->routingKey.isEmpty()) {
+        base += KDBusServicePrivate::shardSuffix(d->routingKey);
+    }
+
+    QStringList instances;
+    for (const QString &name : d->applicationNames(this)) {
+        if (KDBusServicePrivate::isInstanceName(name, base)) {
+            instances.append(name);
+        }
+    }
+    return instances;
+}
+
+void KDBusService::setLoadHint(int load, int capacity)
+{
+    d->load = load;
+    d->capacity = capacity;
+}
+
+void KDBusService::setActivationRateLimit(int requestsPerSecond, int burst)
+{
+    d->dispatcher->setRateLimit(requestsPerSecond, burst);
+}
+
+int KDBusService::pendingActivations(ActivationPriority priority) const
+{
+    return d->dispatcher->pendingActivations(priority);
+}
+
 void KDBusService::unregister()
 {
     QDBusConnectionInterface *bus = nullptr;
@@ -306,42 +893,95 @@ void KDBusService::unregister()
     bus->unregisterService(d->serviceName);
 }
 
-void KDBusService::Activate(const QVariantMap &platform_data)
+void KDBusService::Activate(const KDBusServicePlatformData &platform_data)
 {
+    KDBUSADDONS_TRACE_SCOPE(KDBusService_Activate);
+
     d->handlePlatformData(platform_data);
+    d->leavePreload(this);
     Q_EMIT activateRequested(QStringList(QCoreApplication::arguments()[0]), QDir::currentPath());
     qunsetenv("XDG_ACTIVATION_TOKEN");
+    d->reportLaunchLatency(this);
 }
 
-void KDBusService::Open(const QStringList &uris, const QVariantMap &platform_data)
+void KDBusService::Open(const QStringList &uris, const KDBusServicePlatformData &platform_data)
 {
+    KDBUSADDONS_TRACE_SCOPE(KDBusService_Open, uris.size());
+
     d->handlePlatformData(platform_data);
+    d->leavePreload(this);
     Q_EMIT openRequested(QUrl::fromStringList(uris));
     qunsetenv("XDG_ACTIVATION_TOKEN");
+    d->reportLaunchLatency(this);
 }
 
-void KDBusService::ActivateAction(const QString &action_name, const QVariantList &maybeParameter, const QVariantMap &platform_data)
+void KDBusService::ActivateAction(const QString &action_name, const QVariant &parameter, const KDBusServicePlatformData &platform_data)
 {
-    d->handlePlatformData(platform_data);
+    KDBUSADDONS_TRACE_SCOPE(KDBusService_ActivateAction, action_name);
 
-    // This is a workaround for D-Bus not supporting null variants.
-    const QVariant param = maybeParameter.count() == 1 ? maybeParameter.first() : QVariant();
-
-    Q_EMIT activateActionRequested(action_name, param);
+    d->handlePlatformData(platform_data);
+    d->leavePreload(this);
+    Q_EMIT activateActionRequested(action_name, parameter);
     qunsetenv("XDG_ACTIVATION_TOKEN");
+    d->reportLaunchLatency(this);
 }
 
-int KDBusService::CommandLine(const QStringList &arguments, const QString &workingDirectory, const QVariantMap &platform_data)
+int KDBusService::CommandLine(const QStringList &arguments, const QString &workingDirectory, const KDBusServicePlatformData &platform_data)
 {
+    KDBUSADDONS_TRACE_SCOPE(KDBusService_CommandLine, arguments.size());
+
     d->exitValue = 0;
     d->handlePlatformData(platform_data);
+    d->leavePreload(this);
     // The TODOs here only make sense if this method can be called from the GUI.
     // If it's for pure "usage in the terminal" then no startup notification got started.
     // But maybe one day the workspace wants to call this for the Exec key of a .desktop file?
     Q_EMIT activateRequested(arguments, workingDirectory);
     qunsetenv("XDG_ACTIVATION_TOKEN");
+    d->reportLaunchLatency(this);
     return d->exitValue;
 }
 
+void KDBusService::ActivateActions(const QList<KDBusServiceAction> &actions, const KDBusServicePlatformData &platform_data)
+{
+    d->handlePlatformData(platform_data);
+    d->leavePreload(this);
+
+    for (const KDBusServiceAction &action : actions) {
+        // This is a workaround for D-Bus not supporting null variants.
+        const QVariant param = action.parameter.count() == 1 ? action.parameter.first() : QVariant();
+        Q_EMIT activateActionRequested(action.name, param);
+    }
+
+    qunsetenv("XDG_ACTIVATION_TOKEN");
+    d->reportLaunchLatency(this);
+}
+
+int KDBusService::LoadHint(int &capacity)
+{
+    capacity = d->capacity;
+    return d->load;
+}
+
+QDBusVariant KDBusService::HandOver()
+{
+    // D-Bus calls are handled one at a time, so every activation request
+    // that arrived before this one has been dealt with already.
+    d->handOverState.clear();
+    Q_EMIT handOverRequested();
+
+    const QDBusVariant state = KDBusPayload::pack(d->handOverState, QDBusConnection::sessionBus());
+    d->handOverState.clear();
+
+    // Only make way once the reply carrying the state has been sent
+    auto makeWay = [this]() {
+        unregister();
+        QCoreApplication::quit();
+    };
+    QMetaObject::invokeMethod(this, makeWay, Qt::QueuedConnection);
+
+    return state;
+}
+
 #include "kdbusservice.moc"
 #include "moc_kdbusservice.cpp"
@@ -17,6 +17,9 @@
 #include <kdbusaddons_export.h>
 
 class KDBusServicePrivate;
+struct KDBusServiceAction;
+struct KDBusServicePlatformData;
+class QDBusVariant;
 
 /**
  * @class KDBusService kdbusservice.h <KDBusService>
@@ -116,9 +119,89 @@ public:
          * If exported, it will try first quitting the service calling @c org.qtproject.Qt.QCoreApplication.quit,
          * which is exported by KDBusService by default.
          *
+         * Since 6.12, if the running instance uses KDBusService as well, it is
+         * asked to hand its state over instead: it emits handOverRequested(),
+         * releases the name and quits, and the state it provided with
+         * setHandOverState() becomes available from handedOverState() in the
+         * new instance. The running instance only hands its state over to a
+         * process waiting in the queue for its name, so this needs to be
+         * combined with @c Unique. Launches reaching the running instance after
+         * the hand-over are forwarded again to the new instance.
+         *
          * @since 5.65
          */
-        Replace = 8
+        Replace = 8,
+        /**
+         * Indicates that a new @c Multiple instance should hand its launch over to
+         * the least loaded running instance of the application, if one has headroom.
+         *
+         * Running instances publish their load with setLoadHint(). If none of them
+         * has published a load below its capacity, the new process registers as a
+         * regular @c Multiple instance. Otherwise the arguments are forwarded like
+         * in @c Unique mode and the new process exits.
+         *
+         * Only meaningful in combination with @c Multiple.
+         *
+         * @since 6.12
+         */
+        LoadBalanced = 16,
+        /**
+         * Indicates that if a @c Unique instance is already running, this process
+         * should wait in line as its hot standby instead of forwarding its
+         * arguments and exiting.
+         *
+         * The standby stays queued for the service name, with isRegistered()
+         * returning @c false and isStandby() returning @c true, until the
+         * running instance goes away, for example because it crashed. The bus
+         * then hands the name over immediately and promoted() is emitted, at
+         * which point the application should take over the primary's duties.
+         * The standby can do all its expensive initialization beforehand.
+         *
+         * Only meaningful in combination with @c Unique, and cannot be combined
+         * with @c Replace.
+         *
+         * @since 6.12
+         */
+        Standby = 32,
+        /**
+         * Indicates that the application is being preloaded, for example at
+         * session start, and should stay hidden until it is first activated.
+         *
+         * The service name is registered as in @c Unique mode, but isPreloaded()
+         * returns @c true and the application is expected to not show any user
+         * interface yet. The first activation request, be it from a later launch
+         * of the application or from D-Bus activation, emits preloadActivated()
+         * right before the regular signal for that request, which is the time to
+         * build the user interface. Visible launches then only cost a D-Bus round
+         * trip and the creation of the window.
+         *
+         * If the application is already running, a preloading process exits
+         * without activating it.
+         *
+         * Only meaningful in combination with @c Unique.
+         *
+         * @since 6.12
+         */
+        Preload = 64,
+        /**
+         * Indicates that processes launched at about the same time, for example
+         * by a script opening many files at once, should forward their arguments
+         * to the running @c Unique instance together instead of one by one.
+         *
+         * The first of them to find the instance running collects the launches of
+         * the others for a short moment and forwards all of them in a single call.
+         * The moment lasts 50 ms, or as many milliseconds as the
+         * @c KDBUSSERVICE_AGGREGATION_WINDOW environment variable says.
+         * The running instance then emits activateRequested() for each launch as
+         * usual, and every process exits with the exit value set for its own launch.
+         * If the running instance does not support batches, every process forwards
+         * its own launch.
+         *
+         * Only meaningful in combination with @c Unique.
+         *
+         * @since 6.12
+         */
+        AggregateLaunches = 128,
     };
     Q_ENUM(StartupOption)
 
@@ -128,6 +211,37 @@ public:
     Q_DECLARE_FLAGS(StartupOptions, StartupOption)
     Q_FLAG(StartupOptions)
 
+    /**
+     * Classes of activation requests, in the order they are handled.
+     *
+     * Incoming activation requests are queued per class. Requests of a higher
+     * class are handled first, while requests of the same class are handled in
+     * the order they arrived. Only one request is handled per event loop
+     * iteration, so that an interactive request arriving in the middle of a
+     * long batch of bulk requests does not have to wait for the whole batch.
+     *
+     * Requests the application sends to its own service over the same
+     * connection are not queued but handled right away, as the sender is
+     * blocked waiting for the reply.
+     *
+     * @see pendingActivations()
+     * @since 6.12
+     */
+    enum ActivationPriority {
+        /**
+         * Requests a user is likely waiting for: @c Activate and @c ActivateAction,
+         * for example triggered from a notification.
+         */
+        InteractivePriority = 0,
+        /**
+         * Requests that may come in large numbers: @c Open and @c CommandLine.
+         * A few of these are still let through between interactive requests so
+         * they cannot be starved.
+         */
+        BulkPriority = 1,
+    };
+    Q_ENUM(ActivationPriority)
+
     /**
      * Tries to register the current process to D-Bus at an address based on the
      * application name and organization domain.
@@ -145,6 +259,25 @@ public:
      */
     explicit KDBusService(StartupOptions options = Multiple, QObject *parent = nullptr);
 
+    /**
+     * Tries to register the current process to D-Bus as the shard of the
+     * application selected by @p routingKey.
+     *
+     * This behaves like KDBusService(StartupOptions, QObject *), except that a
+     * stable hash of @p routingKey is appended to the service name, for example
+     * @c org.kde.kdevelop.shard_3f2a9c0d1e4b5a67. In @c Unique mode this makes
+     * uniqueness apply per routing key: running the application again with the
+     * same key activates the instance already serving that key, while a
+     * different key starts a new instance. A typical routing key is the root
+     * directory of a project.
+     *
+     * An empty @p routingKey is equivalent to not sharding at all.
+     *
+     * @see runningShards()
+     * @since 6.12
+     */
+    KDBusService(StartupOptions options, const QString &routingKey, QObject *parent = nullptr);
+
     /**
      * Destroys this object (but does not unregister the application).
      *
@@ -163,6 +296,22 @@ public:
      */
     bool isRegistered() const;
 
+    /**
+     * Returns true if this is a @c Standby instance still waiting for the
+     * running instance to release the service name.
+     * @see promoted()
+     * @since 6.12
+     */
+    bool isStandby() const;
+
+    /**
+     * Returns true if this instance was started with the @c Preload option and
+     * has not been activated yet.
+     * @see preloadActivated()
+     * @since 6.12
+     */
+    bool isPreloaded() const;
+
     /**
      * Returns the name of the D-Bus service registered by this class.
      * Mostly useful when using the option Multiple.
@@ -170,6 +319,72 @@ public:
      */
     QString serviceName() const;
 
+    /**
+     * Returns the routing key this instance was registered with, or an empty
+     * string if the application is not sharded.
+     * @since 6.12
+     */
+    QString routingKey() const;
+
+    /**
+     * Returns the D-Bus service names of all shards of this application that
+     * are currently registered on the session bus, including this one.
+     *
+     * Only the hashed names are known to the bus, so routing keys cannot be
+     * recovered from the result.
+     * @since 6.12
+     */
+    QStringList runningShards() const;
+
+    /**
+     * Returns the D-Bus service names of all running instances of this
+     * application, including this one.
+     *
+     * In @c Multiple mode these are the per-process names (for example
+     * @c org.kde.konqueror-12345), in @c Unique mode there is at most one.
+     *
+     * The list is kept up to date from the bus's @c NameOwnerChanged signal
+     * after the first call, so calling this repeatedly is cheap.
+     * @since 6.12
+     */
+    QStringList runningInstances() const;
+
+    /**
+     * Publishes how busy this instance is.
+     *
+     * Launches using the @c LoadBalanced option pick the running instance with
+     * the lowest @p load relative to its @p capacity, skipping instances whose
+     * load has reached their capacity. The unit is up to the application, for
+     * example the number of open documents.
+     *
+     * The default capacity is @c 0, which means this instance does not take
+     * over launches of other processes.
+     * @since 6.12
+     */
+    void setLoadHint(int load, int capacity);
+
+    /**
+     * Limits how often a single D-Bus client may call the activation methods.
+     *
+     * Every client, as identified by its unique bus name, may make up to
+     * @p burst calls to @c Activate, @c Open, @c ActivateAction or
+     * @c CommandLine in a row, and then up to @p requestsPerSecond calls per
+     * second on average. Calls exceeding that fail with
+     * @c org.freedesktop.DBus.Error.LimitsExceeded without emitting any signal,
+     * so a misbehaving script cannot flood the application.
+     *
+     * A @p requestsPerSecond of @c 0, the default, disables the limit.
+     * @since 6.12
+     */
+    void setActivationRateLimit(int requestsPerSecond, int burst);
+
+    /**
+     * Returns the number of activation requests of the given @p priority that
+     * have been received but not handled yet.
+     * @since 6.12
+     */
+    int pendingActivations(ActivationPriority priority) const;
+
     /**
      * Returns the error message from the D-Bus registration if it failed.
      *
@@ -193,6 +408,33 @@ public:
      */
     void setExitValue(int value);
 
+    /**
+     * Sets the state to hand over to a new instance replacing this one.
+     *
+     * A slot connected to handOverRequested() should serialize whatever the
+     * replacing instance needs to continue seamlessly and pass it here. Large
+     * states are passed as a file descriptor rather than through the bus.
+     *
+     * Note that this will only work if the signal-slot connection type is
+     * Qt::DirectConnection.
+     *
+     * @see Replace
+     * @since 6.12
+     */
+    void setHandOverState(const QByteArray &state);
+
+    /**
+     * Returns the state handed over by the instance this one replaced, or an
+     * empty QByteArray if there was none.
+     *
+     * This is available right after construction, so the application can
+     * restore it before entering the event loop.
+     *
+     * @see Replace, stateHandedOver()
+     * @since 6.12
+     */
+    QByteArray handedOverState() const;
+
 Q_SIGNALS:
     /**
      * Signals that the application is to be activated.
@@ -268,9 +510,86 @@ Q_SIGNALS:
      * for details.
      *
      * See the desktop entry specification for more information about action activation.
+     *
+     * Since 6.12 several actions can be triggered in one go with the
+     * @c org.kde.KDBusService.ActivateActions method, which takes an array of
+     * action names with their parameters and a single set of platform data.
+     * This signal is then emitted once per action, in order.
      */
     void activateActionRequested(const QString &actionName, const QVariant &parameter);
 
+    /**
+     * Signals that this @c Standby instance now owns the service name.
+     *
+     * This is emitted once the previously running instance released the name,
+     * usually because it exited or crashed. From here on isRegistered() returns
+     * @c true and activation requests are delivered to this instance.
+     *
+     * @see Standby
+     * @since 6.12
+     */
+    void promoted();
+
+    /**
+     * Signals that a preloaded instance is activated for the first time.
+     *
+     * This is emitted before activateRequested(), openRequested() or
+     * activateActionRequested() for the first activation request received by
+     * an instance started with the @c Preload option. Platform data such as the
+     * activation token is already in place, so this is where the user
+     * interface should be created.
+     *
+     * @see Preload
+     * @since 6.12
+     */
+    void preloadActivated();
+
+    /**
+     * Signals how long a launch of the application took to be handled.
+     *
+     * When a duplicate instance of a @c Unique application (or a @c LoadBalanced
+     * launch) forwards its arguments, it includes the time its process started.
+     * After the activation request has been handled, that is after the
+     * connected slots of the corresponding signal returned, this signal is
+     * emitted with the time elapsed since then. This is the latency the user
+     * experienced when launching the application again.
+     *
+     * The measurements are also logged as info messages of the
+     * @c kf.dbusaddons.latency logging category.
+     *
+     * @param launcherPid  The process id of the duplicate instance.
+     * @param latencyUsec  The elapsed time in microseconds.
+     *
+     * @since 6.12
+     */
+    void launchLatencyMeasured(qint64 launcherPid, qint64 latencyUsec);
+
+    /**
+     * Signals that a new instance started with the @c Replace option is taking over.
+     *
+     * The connected slot should call setHandOverState() with the state to pass
+     * on. All activation requests received before this signal have been handled
+     * at this point. Afterwards this instance answers activation requests
+     * with an error, so that the launching processes forward them to the new
+     * instance, releases its service name and quits.
+     *
+     * Only a process queued for the service name can request the hand-over.
+     *
+     * @since 6.12
+     */
+    void handOverRequested();
+
+    /**
+     * Signals that this instance received the state of the instance it replaced.
+     *
+     * This is emitted once the event loop is running, with the same state as
+     * handedOverState(). It is not emitted if the replaced instance did not
+     * provide any state.
+     *
+     * @since 6.12
+     */
+    void stateHandedOver(const QByteArray &state);
+
 public Q_SLOTS:
     /**
      * Manually unregister the given serviceName from D-Bus.
@@ -279,14 +598,16 @@ public Q_SLOTS:
 
 private:
     // fdo.Application spec
-    KDBUSADDONS_NO_EXPORT void Activate(const QVariantMap &platform_data);
-    KDBUSADDONS_NO_EXPORT void Open(const QStringList &uris, const QVariantMap &platform_data);
-    KDBUSADDONS_NO_EXPORT void ActivateAction(const QString &action_name, const QVariantList &maybeParameter, const QVariantMap &platform_data);
-    friend class KDBusServiceAdaptor;
+    KDBUSADDONS_NO_EXPORT void Activate(const KDBusServicePlatformData &platform_data);
+    KDBUSADDONS_NO_EXPORT void Open(const QStringList &uris, const KDBusServicePlatformData &platform_data);
+    KDBUSADDONS_NO_EXPORT void ActivateAction(const QString &action_name, const QVariant &parameter, const KDBusServicePlatformData &platform_data);
 
     // org.kde.KDBusService
-    KDBUSADDONS_NO_EXPORT int CommandLine(const QStringList &arguments, const QString &workingDirectory, const QVariantMap &platform_data);
-    friend class KDBusServiceExtensionsAdaptor;
+    KDBUSADDONS_NO_EXPORT int CommandLine(const QStringList &arguments, const QString &workingDirectory, const KDBusServicePlatformData &platform_data);
+    KDBUSADDONS_NO_EXPORT void ActivateActions(const QList<KDBusServiceAction> &actions, const KDBusServicePlatformData &platform_data);
+    KDBUSADDONS_NO_EXPORT int LoadHint(int &capacity);
+    KDBUSADDONS_NO_EXPORT QDBusVariant HandOver();
+    friend class KDBusServiceDispatcher;
 
 private:
     std::unique_ptr<KDBusServicePrivate> const d;
@@ -0,0 +1,79 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KDBUSSERVICEACTION_P_H
+#define KDBUSSERVICEACTION_P_H
+
+#include <QDBusArgument>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantMap>
+
+/*
+ * One element of org.kde.KDBusService.ActivateActions, "(sav)".
+ *
+ * Like with org.freedesktop.Application.ActivateAction the parameter is
+ * wrapped in an array which is empty if there is none.
+ */
+struct KDBusServiceAction {
+    QString name;
+    QVariantList parameter;
+};
+
+using KDBusServiceActionList = QList<KDBusServiceAction>;
+
+inline QDBusArgument &operator<<(QDBusArgument &argument, const KDBusServiceAction &action)
+{
+    argument.beginStructure();
+    argument << action.name << action.parameter;
+    argument.endStructure();
+    return argument;
+}
+
+inline const QDBusArgument &operator>>(const QDBusArgument &argument, KDBusServiceAction &action)
+{
+    argument.beginStructure();
+    argument >> action.name >> action.parameter;
+    argument.endStructure();
+    return argument;
+}
+
+/*
+ * One element of org.kde.KDBusService.CommandLineBatch, "(assa{sv})": the
+ * arguments of CommandLine, with empty arguments meaning an Activate call.
+ */
+struct KDBusServiceLaunch {
+    QStringList arguments;
+    QString workingDirectory;
+    QVariantMap platformData;
+};
+
+using KDBusServiceLaunchList = QList<KDBusServiceLaunch>;
+
+inline QDBusArgument &operator<<(QDBusArgument &argument, const KDBusServiceLaunch &launch)
+{
+    argument.beginStructure();
+    argument << launch.arguments << launch.workingDirectory << launch.platformData;
+    argument.endStructure();
+    return argument;
+}
+
+inline const QDBusArgument &operator>>(const QDBusArgument &argument, KDBusServiceLaunch &launch)
+{
+    argument.beginStructure();
+    argument >> launch.arguments >> launch.workingDirectory >> launch.platformData;
+    argument.endStructure();
+    return argument;
+}
+
+Q_DECLARE_METATYPE(KDBusServiceAction)
+Q_DECLARE_METATYPE(KDBusServiceLaunch)
+
+#endif
@@ -0,0 +1,439 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "kdbusservicedispatcher_p.h"
+#include "kdbusservice.h"
+
+#include <QDBusArgument>
+#include <QDBusMetaType>
+#include <QDBusReply>
+
+#include "kdbusaddons_debug.h"
+
+// Once there are more callers than this, buckets that are full again are dropped
+static const int s_maxIdleBuckets = 64;
+
+// Number of interactive requests handled in a row before a waiting bulk request gets its turn
+static const int s_maxInteractiveStreak = 4;
+
+static const QLatin1String s_applicationInterface("org.freedesktop.Application");
+static const QLatin1String s_extensionsInterface("org.kde.KDBusService");
+
+// Keep in sync with org.freedesktop.Application.xml and org.kde.KDBusService.xml
+static const char s_introspection[] =
+    "  <interface name=\"org.freedesktop.Application\">\n"
+    "    <method name=\"Activate\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"QVariantMap\"/>\n"
+    "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+    "    </method>\n"
+    "    <method name=\"Open\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"QVariantMap\"/>\n"
+    "      <arg name=\"uris\" type=\"as\" direction=\"in\"/>\n"
+    "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+    "    </method>\n"
+    "    <method name=\"ActivateAction\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"QVariantMap\"/>\n"
+    "      <arg name=\"action_name\" type=\"s\" direction=\"in\"/>\n"
+    "      <arg name=\"parameter\" type=\"av\" direction=\"in\"/>\n"
+    "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+    "    </method>\n"
+    "  </interface>\n"
+    "  <interface name=\"org.kde.KDBusService\">\n"
+    "    <method name=\"CommandLine\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In2\" value=\"QVariantMap\"/>\n"
+    "      <arg name=\"arguments\" type=\"as\" direction=\"in\"/>\n"
+    "      <arg name=\"working-dir\" type=\"s\" direction=\"in\"/>\n"
+    "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+    "      <arg type=\"i\" direction=\"out\"/>\n"
+    "    </method>\n"
+    "    <method name=\"ActivateActions\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"KDBusServiceActionList\"/>\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In1\" value=\"QVariantMap\"/>\n"
+    "      <arg name=\"actions\" type=\"a(sav)\" direction=\"in\"/>\n"
+    "      <arg name=\"platform-data\" type=\"a{sv}\" direction=\"in\"/>\n"
+    "    </method>\n"
+    "    <method name=\"CommandLineBatch\">\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.In0\" value=\"KDBusServiceLaunchList\"/>\n"
+    "      <annotation name=\"org.qtproject.QtDBus.QtTypeName.Out0\" value=\"QList&lt;int&gt;\"/>\n"
+    "      <arg name=\"launches\" type=\"a(assa{sv})\" direction=\"in\"/>\n"
+    "      <arg name=\"exit-statuses\" type=\"ai\" direction=\"out\"/>\n"
+    "    </method>\n"
+    "    <method name=\"LoadHint\">\n"
+    "      <arg name=\"load\" type=\"i\" direction=\"out\"/>\n"
+    "      <arg name=\"capacity\" type=\"i\" direction=\"out\"/>\n"
+    "    </method>\n"
+    "    <method name=\"HandOver\">\n"
+    "      <arg name=\"state\" type=\"v\" direction=\"out\"/>\n"
+    "    </method>\n"
+    "  </interface>\n";
+
+static void readPlatformDataEntry(KDBusServicePlatformData &data, const QString &key, const QVariant &value)
+{
+    if (key == QLatin1String("desktop-startup-id")) {
+        data.desktopStartupId = value.toByteArray();
+    } else if (key == QLatin1String("activation-token")) {
+        data.activationToken = value.toByteArray();
+    } else if (key == QLatin1String("kde-launch-timestamp")) {
+        // Anything but a number leaves the launch unmeasured
+        bool ok = false;
+        const qint64 timestamp = value.toLongLong(&ok);
+        data.launchTimestamp = ok ? timestamp : 0;
+    } else if (key == QLatin1String("kde-launch-pid")) {
+        data.launcherPid = value.toLongLong();
+    }
+}
+
+// Reads an "a{sv}" argument without building a QVariantMap out of it
+static KDBusServicePlatformData readPlatformData(const QVariant &argument)
+{
+    KDBusServicePlatformData data;
+
+    if (argument.metaType() == QMetaType::fromType<QDBusArgument>()) {
+        const QDBusArgument map = argument.value<QDBusArgument>();
+        map.beginMap();
+        while (!map.atEnd()) {
+            QString key;
+            QDBusVariant value;
+            map.beginMapEntry();
+            map >> key >> value;
+            map.endMapEntry();
+            readPlatformDataEntry(data, key, value.variant());
+        }
+        map.endMap();
+    } else {
+        const QVariantMap map = argument.toMap();
+        for (auto it = map.cbegin(); it != map.cend(); ++it) {
+            readPlatformDataEntry(data, it.key(), it.value());
+        }
+    }
+
+    return data;
+}
+
+// D-Bus has no null variants, so the optional action parameter comes wrapped in an "av"
+static QVariant readMaybeParameter(const QVariant &argument)
+{
+    if (argument.metaType() == QMetaType::fromType<QDBusArgument>()) {
+        const QDBusArgument array = argument.value<QDBusArgument>();
+        QVariant parameter;
+        int count = 0;
+        array.beginArray();
+        while (!array.atEnd()) {
+            QDBusVariant value;
+            array >> value;
+            if (count++ == 0) {
+                parameter = value.variant();
+            }
+        }
+        array.endArray();
+        return count == 1 ? parameter : QVariant();
+    }
+
+    const QVariantList list = argument.toList();
+    return list.count() == 1 ? list.first() : QVariant();
+}
+
+static KDBusServiceActionList readActions(const QVariant &argument)
+{
+    if (argument.metaType() == QMetaType::fromType<QDBusArgument>()) {
+        return qdbus_cast<KDBusServiceActionList>(argument.value<QDBusArgument>());
+    }
+    return argument.value<KDBusServiceActionList>();
+}
+
+static KDBusServiceLaunchList readLaunches(const QVariant &argument)
+{
+    if (argument.metaType() == QMetaType::fromType<QDBusArgument>()) {
+        return qdbus_cast<KDBusServiceLaunchList>(argument.value<QDBusArgument>());
+    }
+    return argument.value<KDBusServiceLaunchList>();
+}
+
+KDBusServiceDispatcher::KDBusServiceDispatcher(KDBusService *service)
+    : QDBusVirtualObject(service)
+    , q(service)
+{
+    qDBusRegisterMetaType<KDBusServiceAction>();
+    qDBusRegisterMetaType<KDBusServiceActionList>();
+    qDBusRegisterMetaType<KDBusServiceLaunch>();
+    qDBusRegisterMetaType<KDBusServiceLaunchList>();
+
+    processTimer.setSingleShot(true);
+    processTimer.setInterval(0);
+    connect(&processTimer, &QTimer::timeout, this, &KDBusServiceDispatcher::processNext);
+}
+
+QString KDBusServiceDispatcher::introspect(const QString &path) const
+{
+    Q_UNUSED(path);
+    return QString::fromLatin1(s_introspection);
+}
+
+bool KDBusServiceDispatcher::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    const QString interface = message.interface();
+    const QString member = message.member();
+    const QVariantList arguments = message.arguments();
+
+    auto signatureMatches = [&message, &connection](QLatin1String expected) {
+        if (message.signature() == expected) {
+            return true;
+        }
+        const QString error = QStringLiteral("%1 expects arguments of type \"%2\"").arg(message.member(), expected);
+        connection.send(message.createErrorReply(QDBusError::InvalidSignature, error));
+        return false;
+    };
+
+    // After the hand-over, the caller must not take its launch as handled but wait for the new instance
+    auto notHandedOver = [this, &message, &connection]() {
+        if (!handedOver) {
+            return true;
+        }
+        connection.send(message.createErrorReply(QStringLiteral("org.kde.KDBusService.Error.HandedOver"), QStringLiteral("The service is being replaced")));
+        return false;
+    };
+
+    if (interface.isEmpty() || interface == s_applicationInterface) {
+        if (member == QLatin1String("Activate")) {
+            if (signatureMatches(QLatin1String("a{sv}")) && notHandedOver() && admit(message, connection)) {
+                const KDBusServicePlatformData platformData = readPlatformData(arguments.at(0));
+                enqueue(message, connection, KDBusService::InteractivePriority, [this, platformData]() {
+                    q->Activate(platformData);
+                    return QVariantList();
+                });
+            }
+            return true;
+        }
+        if (member == QLatin1String("Open")) {
+            if (signatureMatches(QLatin1String("asa{sv}")) && notHandedOver() && admit(message, connection)) {
+                const QStringList uris = arguments.at(0).toStringList();
+                const KDBusServicePlatformData platformData = readPlatformData(arguments.at(1));
+                enqueue(message, connection, KDBusService::BulkPriority, [this, uris, platformData]() {
+                    q->Open(uris, platformData);
+                    return QVariantList();
+                });
+            }
+            return true;
+        }
+        if (member == QLatin1String("ActivateAction")) {
+            if (signatureMatches(QLatin1String("sava{sv}")) && notHandedOver() && admit(message, connection)) {
+                const QString actionName = arguments.at(0).toString();
+                const QVariant parameter = readMaybeParameter(arguments.at(1));
+                const KDBusServicePlatformData platformData = readPlatformData(arguments.at(2));
+                enqueue(message, connection, KDBusService::InteractivePriority, [this, actionName, parameter, platformData]() {
+                    q->ActivateAction(actionName, parameter, platformData);
+                    return QVariantList();
+                });
+            }
+            return true;
+        }
+    }
+
+    if (interface.isEmpty() || interface == s_extensionsInterface) {
+        if (member == QLatin1String("CommandLine")) {
+            if (signatureMatches(QLatin1String("assa{sv}")) && notHandedOver() && admit(message, connection)) {
+                const QStringList commandLine = arguments.at(0).toStringList();
+                const QString workingDirectory = arguments.at(1).toString();
+                const KDBusServicePlatformData platformData = readPlatformData(arguments.at(2));
+                enqueue(message, connection, KDBusService::BulkPriority, [this, commandLine, workingDirectory, platformData]() {
+                    return QVariantList{q->CommandLine(commandLine, workingDirectory, platformData)};
+                });
+            }
+            return true;
+        }
+        if (member == QLatin1String("CommandLineBatch")) {
+            if (signatureMatches(QLatin1String("a(assa{sv})")) && notHandedOver() && admit(message, connection)) {
+                const KDBusServiceLaunchList launches = readLaunches(arguments.at(0));
+                enqueue(message, connection, KDBusService::BulkPriority, [this, launches]() {
+                    QList<int> exitValues;
+                    exitValues.reserve(launches.size());
+                    for (const KDBusServiceLaunch &launch : launches) {
+                        const KDBusServicePlatformData platformData = readPlatformData(launch.platformData);
+                        if (launch.arguments.isEmpty()) {
+                            q->Activate(platformData);
+                            exitValues.append(0);
+                        } else {
+                            exitValues.append(q->CommandLine(launch.arguments, launch.workingDirectory, platformData));
+                        }
+                    }
+                    return QVariantList{QVariant::fromValue(exitValues)};
+                });
+            }
+            return true;
+        }
+        if (member == QLatin1String("ActivateActions")) {
+            if (signatureMatches(QLatin1String("a(sav)a{sv}")) && notHandedOver() && admit(message, connection)) {
+                const KDBusServiceActionList actions = readActions(arguments.at(0));
+                const KDBusServicePlatformData platformData = readPlatformData(arguments.at(1));
+                enqueue(message, connection, KDBusService::InteractivePriority, [this, actions, platformData]() {
+                    q->ActivateActions(actions, platformData);
+                    return QVariantList();
+                });
+            }
+            return true;
+        }
+        if (member == QLatin1String("LoadHint")) {
+            if (signatureMatches(QLatin1String(""))) {
+                int capacity = 0;
+                const int load = q->LoadHint(capacity);
+                connection.send(message.createReply(QVariantList{load, capacity}));
+            }
+            return true;
+        }
+        if (member == QLatin1String("HandOver")) {
+            if (signatureMatches(QLatin1String("")) && notHandedOver()) {
+                handOver(message, connection);
+            }
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int KDBusServiceDispatcher::pendingActivations(KDBusService::ActivationPriority priority) const
+{
+    return queues[priority].size();
+}
+
+bool KDBusServiceDispatcher::hasPendingActivations() const
+{
+    return !queues[KDBusService::InteractivePriority].isEmpty() || !queues[KDBusService::BulkPriority].isEmpty();
+}
+
+void KDBusServiceDispatcher::enqueue(const QDBusMessage &message,
+                                     const QDBusConnection &connection,
+                                     KDBusService::ActivationPriority priority,
+                                     std::function<QVariantList()> &&handle)
+{
+    // A call to ourselves on the same connection goes through the local loop, which
+    // blocks the caller until it is answered and cannot take a reply sent later
+    if (message.service() == connection.baseService()) {
+        const QVariantList arguments = handle();
+        if (message.isReplyRequired()) {
+            connection.send(message.createReply(arguments));
+        }
+        return;
+    }
+
+    queues[priority].enqueue(Request{message, connection, std::move(handle)});
+
+    // The timer only fires once all calls already delivered to us are queued,
+    // which is what gives later interactive requests the chance to overtake.
+    if (!processTimer.isActive()) {
+        processTimer.start();
+    }
+}
+
+void KDBusServiceDispatcher::processNext()
+{
+    QQueue<Request> &interactive = queues[KDBusService::InteractivePriority];
+    QQueue<Request> &bulk = queues[KDBusService::BulkPriority];
+
+    const bool takeBulk = interactive.isEmpty() || (!bulk.isEmpty() && interactiveStreak >= s_maxInteractiveStreak);
+    if (takeBulk && bulk.isEmpty()) {
+        return;
+    }
+
+    Request request = takeBulk ? bulk.dequeue() : interactive.dequeue();
+    // Only a streak that made bulk requests wait counts
+    interactiveStreak = takeBulk || bulk.isEmpty() ? 0 : interactiveStreak + 1;
+
+    // Come back for the next one after giving newly arrived calls a chance to queue up
+    if (hasPendingActivations()) {
+        processTimer.start();
+    }
+
+    const QVariantList arguments = request.handle();
+    if (request.message.isReplyRequired()) {
+        request.connection.send(request.message.createReply(arguments));
+    }
+}
+
+void KDBusServiceDispatcher::setRateLimit(int requestsPerSecond, int burst)
+{
+    rate = qMax(0, requestsPerSecond);
+    this->burst = qMax(1, burst);
+    buckets.clear();
+    lastPrune = 0;
+    if (rate > 0) {
+        clock.start();
+    }
+}
+
+void KDBusServiceDispatcher::refill(Bucket &bucket, qint64 now) const
+{
+    bucket.tokens = qMin<double>(burst, bucket.tokens + (now - bucket.lastRefill) * rate / 1000.0);
+    bucket.lastRefill = now;
+}
+
+bool KDBusServiceDispatcher::admit(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    if (rate <= 0) {
+        return true;
+    }
+
+    const QString sender = message.service();
+    const qint64 now = clock.elapsed();
+
+    // Dropping the buckets that are full again takes a scan of all of them, so it is
+    // done at most once in the time an empty bucket needs to fill up
+    const qint64 fillTime = qint64(burst) * 1000 / rate;
+    if (buckets.size() > s_maxIdleBuckets && now - lastPrune >= fillTime) {
+        lastPrune = now;
+        for (auto it = buckets.begin(); it != buckets.end();) {
+            refill(*it, now);
+            if (it->tokens >= burst) {
+                it = buckets.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    auto it = buckets.find(sender);
+    if (it == buckets.end()) {
+        it = buckets.insert(sender, Bucket{double(burst), now});
+    } else {
+        refill(*it, now);
+    }
+
+    if (it->tokens >= 1) {
+        it->tokens -= 1;
+        return true;
+    }
+
+    qCDebug(KDBUSADDONS_LOG) << "Rejecting" << message.member() << "from" << sender << "- rate limit exceeded";
+    connection.send(message.createErrorReply(QDBusError::LimitsExceeded, QStringLiteral("Too many activation requests, try again later")));
+    return false;
+}
+
+void KDBusServiceDispatcher::handOver(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    // The state goes to the instance about to replace us, which waits in the queue for our name
+    QDBusMessage queuedOwners = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.DBus"),
+                                                               QStringLiteral("/org/freedesktop/DBus"),
+                                                               QStringLiteral("org.freedesktop.DBus"),
+                                                               QStringLiteral("ListQueuedOwners"));
+    queuedOwners << q->serviceName();
+    const QDBusReply<QStringList> owners = connection.call(queuedOwners, QDBus::Block);
+    if (!owners.isValid() || message.service() == connection.baseService() || !owners.value().contains(message.service())) {
+        qCDebug(KDBUSADDONS_LOG) << "Refusing to hand over to" << message.service() << "- it is not queued for" << q->serviceName();
+        connection.send(message.createErrorReply(QDBusError::AccessDenied, QStringLiteral("Only a caller queued for the service name can take it over")));
+        return;
+    }
+
+    // The state must reflect every request received so far
+    while (hasPendingActivations()) {
+        processNext();
+    }
+    connection.send(message.createReply(QVariant::fromValue(q->HandOver())));
+    handedOver = true;
+}
+
+#include "moc_kdbusservicedispatcher_p.cpp"
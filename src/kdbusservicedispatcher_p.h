@@ -0,0 +1,101 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KDBUSSERVICEDISPATCHER_P_H
+#define KDBUSSERVICEDISPATCHER_P_H
+
+#include <QDBusConnection>
+#include <QDBusMessage>
+#include <QDBusVirtualObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QQueue>
+#include <QTimer>
+
+#include <functional>
+
+#include "kdbusservice.h"
+#include "kdbusserviceaction_p.h"
+
+/*
+ * The platform-data keys KDBusService knows about, see org.freedesktop.Application.
+ */
+struct KDBusServicePlatformData {
+    QByteArray desktopStartupId;
+    QByteArray activationToken;
+    qint64 launchTimestamp = 0;
+    qint64 launcherPid = 0;
+};
+
+/*
+ * The object KDBusService exports at its object path.
+ *
+ * It implements org.freedesktop.Application and org.kde.KDBusService by hand
+ * rather than through generated adaptors: the platform data and other
+ * containers are read by iterating their QDBusArgument, picking only the
+ * known keys without building a QVariantMap, and the introspection data is
+ * a constant.
+ *
+ * Activation requests are not handled right away but queued by priority, and
+ * replied to once handled, except for those the application sends itself,
+ * which are handled right away. After a hand-over, they fail with an error.
+ */
+class KDBusServiceDispatcher : public QDBusVirtualObject
+{
+    Q_OBJECT
+
+public:
+    explicit KDBusServiceDispatcher(KDBusService *service);
+
+    void setRateLimit(int requestsPerSecond, int burst);
+    int pendingActivations(KDBusService::ActivationPriority priority) const;
+
+    QString introspect(const QString &path) const override;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+
+private:
+    // An activation request waiting to be handled. handle() returns the reply arguments.
+    struct Request {
+        QDBusMessage message;
+        QDBusConnection connection;
+        std::function<QVariantList()> handle;
+    };
+
+    void enqueue(const QDBusMessage &message,
+                 const QDBusConnection &connection,
+                 KDBusService::ActivationPriority priority,
+                 std::function<QVariantList()> &&handle);
+    void processNext();
+    bool hasPendingActivations() const;
+    void handOver(const QDBusMessage &message, const QDBusConnection &connection);
+
+    // Token bucket of a single caller
+    struct Bucket {
+        double tokens;
+        qint64 lastRefill;
+    };
+
+    // Returns whether the sender of @p message may make another activation request.
+    // If not, an error reply has been sent already.
+    bool admit(const QDBusMessage &message, const QDBusConnection &connection);
+    void refill(Bucket &bucket, qint64 now) const;
+
+    KDBusService *const q;
+    int rate = 0;
+    int burst = 0;
+    QHash<QString, Bucket> buckets;
+    qint64 lastPrune = 0;
+    QElapsedTimer clock;
+
+    QQueue<Request> queues[2]; // indexed by KDBusService::ActivationPriority
+    QTimer processTimer;
+    int interactiveStreak = 0;
+    bool handedOver = false;
+};
+
+#endif
@@ -8,40 +8,296 @@
 
 #include "kdedmodule.h"
 #include "kdbusaddons_debug.h"
+#include "kdbuspayload_p.h"
+#include "kdbusaddons_trace_p.h"
 
+#include <QCoreApplication>
 #include <QDBusConnection>
 #include <QDBusMessage>
 #include <QDBusObjectPath>
+#include <QDBusReply>
+#include <QHash>
+#include <QDBusContext>
+#include <QDBusServer>
+#include <QDBusVirtualObject>
+#include <QPointer>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QTimer>
 
-class KDEDModulePrivate
+#include <algorithm>
+#include <atomic>
+
+static const char s_modules_path[] = "/modules/";
+
+// The private server modules are exported on in addition to the bus, see KDEDModule::enablePeerConnections().
+// Also answers the discovery calls on the bus.
+class KDEDModulePeerServer : public QDBusVirtualObject
 {
+    Q_OBJECT
 public:
-    QString moduleName;
+    explicit KDEDModulePeerServer(QDBusServer *server);
+
+    QString introspect(const QString &path) const override;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+
+    // Exports @p module on every connected peer
+    void registerModule(KDEDModule *module, const QString &path, QDBusConnection::RegisterOptions options);
+    // Removes the module at @p path from every connected peer
+    void unregisterModule(const QString &path);
+    // Sends @p message to every connected peer
+    void send(const QDBusMessage &message);
+
+    QDBusServer *const server;
+
+private:
+    void addConnection(const QDBusConnection &connection);
+    void pruneConnections();
+
+    QList<QDBusConnection> connections;
 };
 
-KDEDModule::KDEDModule(QObject *parent)
-    : QObject(parent)
-    , d(new KDEDModulePrivate)
+// A module registered on the bus, to export on peer connections
+struct KDEDModuleRegistration {
+    QPointer<KDEDModule> module;
+    QString path;
+    QDBusConnection::RegisterOptions options;
+};
+
+static QList<KDEDModuleRegistration> s_registeredModules;
+static QPointer<KDEDModulePeerServer> s_peerServer;
+
+// All module instances, to notify about window registry changes
+static QList<KDEDModule *> s_modules;
+
+// The windows registered with KDEDModule::registerWindow(), along with the changes not announced yet
+struct KDEDModuleWindowRegistry {
+    // Announces the pending changes to all modules
+    void flush();
+    void scheduleFlush();
+
+    QSet<qlonglong> windows;
+    QSet<qlonglong> added;
+    QSet<qlonglong> removed;
+    bool flushScheduled = false;
+};
+
+static KDEDModuleWindowRegistry s_windowRegistry;
+
+static QList<qlonglong> sortedWindows(const QSet<qlonglong> &windows)
 {
+    QList<qlonglong> list(windows.cbegin(), windows.cend());
+    std::sort(list.begin(), list.end());
+    return list;
 }
 
-KDEDModule::~KDEDModule()
+void KDEDModuleWindowRegistry::scheduleFlush()
 {
+    if (flushScheduled) {
+        return;
+    }
+
+    // Without an application there is no event loop to wait for
+    if (!QCoreApplication::instance()) {
+        flush();
+        return;
+    }
+
+    flushScheduled = true;
+    QMetaObject::invokeMethod(QCoreApplication::instance(), [this]() { flush(); }, Qt::QueuedConnection);
 }
 
-void KDEDModule::setModuleName(const QString &name)
+void KDEDModuleWindowRegistry::flush()
 {
-    d->moduleName = name;
-    QDBusObjectPath realPath(QLatin1String("/modules/") + d->moduleName);
+    flushScheduled = false;
+    const QList<qlonglong> registered = sortedWindows(std::exchange(added, {}));
+    const QList<qlonglong> unregistered = sortedWindows(std::exchange(removed, {}));
 
-    if (realPath.path().isEmpty()) {
-        qCWarning(KDBUSADDONS_LOG) << "The kded module name" << name << "is invalid!";
-        return;
+    // Modules may delete others in their slots
+    const QList<QPointer<KDEDModule>> modules(s_modules.cbegin(), s_modules.cend());
+    if (!unregistered.isEmpty()) {
+        for (const QPointer<KDEDModule> &module : modules) {
+            if (module) {
+                Q_EMIT module->windowsUnregistered(unregistered);
+            }
+            // Modules only connected to the per-window signal are told as well
+            for (qlonglong windowId : unregistered) {
+                if (module) {
+                    Q_EMIT module->windowUnregistered(windowId);
+                }
+            }
+        }
+    }
+    if (!registered.isEmpty()) {
+        for (const QPointer<KDEDModule> &module : modules) {
+            if (module) {
+                Q_EMIT module->windowsRegistered(registered);
+            }
+            for (qlonglong windowId : registered) {
+                if (module) {
+                    Q_EMIT module->windowRegistered(windowId);
+                }
+            }
+        }
+    }
+}
+
+KDEDModulePeerServer::KDEDModulePeerServer(QDBusServer *server)
+    : QDBusVirtualObject(server)
+    , server(server)
+{
+    connect(server, &QDBusServer::newConnection, this, &KDEDModulePeerServer::addConnection);
+}
+
+QString KDEDModulePeerServer::introspect(const QString &path) const
+{
+    Q_UNUSED(path);
+    return QStringLiteral(
+        "  <interface name=\"org.kde.KDEDModulePeer\">\n"
+        "    <method name=\"Address\">\n"
+        "      <arg name=\"address\" type=\"s\" direction=\"out\"/>\n"
+        "    </method>\n"
+        "  </interface>\n");
+}
+
+bool KDEDModulePeerServer::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    if (message.member() != QLatin1String("Address")
+        || (!message.interface().isEmpty() && message.interface() != QLatin1String("org.kde.KDEDModulePeer"))) {
+        return false;
     }
+    connection.send(message.createReply(server->address()));
+    return true;
+}
+
+void KDEDModulePeerServer::addConnection(const QDBusConnection &connection)
+{
+    pruneConnections();
+
+    QDBusConnection peer(connection);
+    for (const KDEDModuleRegistration &registration : std::as_const(s_registeredModules)) {
+        if (registration.module) {
+            peer.registerObject(registration.path, registration.module, registration.options);
+        }
+    }
+    connections.append(peer);
+}
+
+void KDEDModulePeerServer::pruneConnections()
+{
+    for (auto it = connections.begin(); it != connections.end();) {
+        if (!it->isConnected()) {
+            QDBusConnection::disconnectFromPeer(it->name());
+            it = connections.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void KDEDModulePeerServer::registerModule(KDEDModule *module, const QString &path, QDBusConnection::RegisterOptions options)
+{
+    pruneConnections();
+    for (QDBusConnection &peer : connections) {
+        peer.registerObject(path, module, options);
+    }
+}
 
+void KDEDModulePeerServer::unregisterModule(const QString &path)
+{
+    pruneConnections();
+    for (QDBusConnection &peer : connections) {
+        peer.unregisterObject(path);
+    }
+}
+
+void KDEDModulePeerServer::send(const QDBusMessage &message)
+{
+    for (const QDBusConnection &peer : std::as_const(connections)) {
+        peer.send(message);
+    }
+}
+
+class KDEDModulePrivate
+{
+public:
+    // Registers @p q to @p bus under @p name, returns the object path or an empty one on failure.
+    // Setting the module name is up to the caller.
+    QDBusObjectPath registerModule(KDEDModule *q, const QString &name, QDBusConnection &bus);
+
+    // Sends the buffered property changes and signals
+    void flushChanges();
+
+    // A signal waiting to be emitted by emitCoalescedSignal()
+    struct PendingSignal {
+        QString interface;
+        QString name;
+        QVariantList arguments;
+    };
+
+    QString moduleName;
+    bool registered = false;
     QDBusConnection::RegisterOptions regOptions;
 
-    if (this->metaObject()->indexOfClassInfo("D-Bus Interface") != -1) {
+    QTimer flushTimer;
+    QHash<QString, QVariantMap> changedProperties; // by interface
+    QList<PendingSignal> pendingSignals;
+
+    std::atomic<int> queuedAsyncCalls = 0;
+    std::atomic<int> activeAsyncCalls = 0;
+    // Set once the module is being destroyed, calls that did not start yet are refused then
+    std::atomic<bool> destroyed = false;
+    int maxQueuedAsyncCalls = -1;
+
+    // Last, so that its destructor waits for the calls still running while the rest is intact
+    QThreadPool asyncPool;
+};
+
+void KDEDModulePrivate::flushChanges()
+{
+    const QHash<QString, QVariantMap> properties = std::exchange(changedProperties, {});
+    const QList<PendingSignal> signalList = std::exchange(pendingSignals, {});
+
+    if (!registered) {
+        return;
+    }
+
+    const QString path = QLatin1String("/modules/") + moduleName;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    for (auto it = properties.cbegin(); it != properties.cend(); ++it) {
+        QDBusMessage message =
+            QDBusMessage::createSignal(path, QStringLiteral("org.freedesktop.DBus.Properties"), QStringLiteral("PropertiesChanged"));
+        message << it.key() << it.value() << QStringList();
+        bus.send(message);
+        if (s_peerServer) {
+            s_peerServer->send(message);
+        }
+    }
+
+    for (const PendingSignal &pending : signalList) {
+        QDBusMessage message = QDBusMessage::createSignal(path, pending.interface, pending.name);
+        message.setArguments(pending.arguments);
+        bus.send(message);
+        if (s_peerServer) {
+            s_peerServer->send(message);
+        }
+    }
+}
+
+QDBusObjectPath KDEDModulePrivate::registerModule(KDEDModule *q, const QString &name, QDBusConnection &bus)
+{
+    KDBUSADDONS_TRACE_SCOPE(KDEDModule_setModuleName, name);
+
+    QDBusObjectPath realPath(QLatin1String("/modules/") + name);
+
+    if (realPath.path().isEmpty()) {
+        qCWarning(KDBUSADDONS_LOG) << "The kded module name" << name << "is invalid!";
+        return QDBusObjectPath();
+    }
+
+    if (q->metaObject()->indexOfClassInfo("D-Bus Interface") != -1) {
         // 1. There are kded modules that don't have a D-Bus interface.
         // 2. qt 4.4.3 crashes when trying to emit signals on class without
         //    Q_CLASSINFO("D-Bus Interface", "<your interface>") but
@@ -55,14 +311,75 @@ void KDEDModule::setModuleName(const QString &name)
         regOptions = QDBusConnection::ExportScriptableSlots //
             | QDBusConnection::ExportScriptableProperties //
             | QDBusConnection::ExportAdaptors;
-        qCDebug(KDBUSADDONS_LOG) << "Registration of kded module" << d->moduleName << "without D-Bus interface.";
+        qCDebug(KDBUSADDONS_LOG) << "Registration of kded module" << name << "without D-Bus interface.";
     }
 
-    if (!QDBusConnection::sessionBus().registerObject(realPath.path(), this, regOptions)) {
+    if (!bus.registerObject(realPath.path(), q, regOptions)) {
         // Happens for khotkeys but the module works. Need some time to investigate.
-        qCDebug(KDBUSADDONS_LOG) << "registerObject() returned false for" << d->moduleName;
+        qCDebug(KDBUSADDONS_LOG) << "registerObject() returned false for" << name;
+        return QDBusObjectPath();
+    }
+
+    registered = true;
+
+    // Registering again, possibly under another name, replaces the earlier registration
+    auto existing = std::find_if(s_registeredModules.begin(), s_registeredModules.end(), [q](const KDEDModuleRegistration &registration) {
+        return registration.module == q;
+    });
+    if (existing == s_registeredModules.end()) {
+        s_registeredModules.append(KDEDModuleRegistration{q, realPath.path(), regOptions});
     } else {
-        // qCDebug(KDBUSADDONS_LOG) << "registerObject() successful for" << d->moduleName;
+        if (existing->path != realPath.path()) {
+            bus.unregisterObject(existing->path);
+            if (s_peerServer) {
+                s_peerServer->unregisterModule(existing->path);
+            }
+        }
+        *existing = KDEDModuleRegistration{q, realPath.path(), regOptions};
+    }
+    if (s_peerServer) {
+        s_peerServer->registerModule(q, realPath.path(), regOptions);
+    }
+
+    return realPath;
+}
+
+KDEDModule::KDEDModule(QObject *parent)
+    : QObject(parent)
+    , d(new KDEDModulePrivate)
+{
+    d->flushTimer.setSingleShot(true);
+    d->flushTimer.setInterval(0);
+    connect(&d->flushTimer, &QTimer::timeout, this, [this]() {
+        d->flushChanges();
+    });
+
+    d->asyncPool.setMaxThreadCount(1);
+    d->asyncPool.setObjectName(QStringLiteral("KDEDModule async calls"));
+
+    s_modules.append(this);
+}
+
+KDEDModule::~KDEDModule()
+{
+    // The work of the queued calls would run on a module that is gone
+    d->destroyed = true;
+    d->asyncPool.waitForDone();
+
+    s_modules.removeOne(this);
+    if (d->registered) {
+        s_registeredModules.removeIf([this](const KDEDModuleRegistration &registration) {
+            return registration.module == this;
+        });
+    }
+}
+
+void KDEDModule::setModuleName(const QString &name)
+{
+    d->moduleName = name;
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    const QDBusObjectPath realPath = d->registerModule(this, name, bus);
+    if (!realPath.path().isEmpty()) {
         // Fix deadlock with Qt 5.6: this has to be delayed until the dbus thread is unlocked
         auto registeredSignal = [this, realPath]() {
             moduleRegistered(realPath);
@@ -71,15 +388,276 @@ void KDEDModule::setModuleName(const QString &name)
     }
 }
 
+void KDEDModule::registerModules(const QList<KDEDModule *> &modules, const QStringList &names)
+{
+    if (modules.size() != names.size()) {
+        qCWarning(KDBUSADDONS_LOG) << "Cannot register" << modules.size() << "kded modules with" << names.size() << "names";
+        return;
+    }
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    QList<std::pair<QPointer<KDEDModule>, QDBusObjectPath>> registered;
+    registered.reserve(modules.size());
+    QSet<KDEDModule *> seen;
+    for (qsizetype i = 0; i < modules.size(); ++i) {
+        KDEDModule *module = modules.at(i);
+        if (!module) {
+            qCWarning(KDBUSADDONS_LOG) << "Cannot register a null kded module as" << names.at(i);
+            continue;
+        }
+        // Only the first name given for a module counts
+        if (seen.contains(module)) {
+            qCWarning(KDBUSADDONS_LOG) << "The kded module" << module->d->moduleName << "is listed more than once, not registering it as" << names.at(i);
+            continue;
+        }
+        seen.insert(module);
+
+        module->d->moduleName = names.at(i);
+        const QDBusObjectPath realPath = module->d->registerModule(module, names.at(i), bus);
+        if (!realPath.path().isEmpty()) {
+            registered.append({module, realPath});
+        }
+    }
+
+    if (registered.isEmpty()) {
+        return;
+    }
+
+    // Delayed like in setModuleName(), the modules may be gone by the time this runs
+    auto registeredSignals = [registered]() {
+        for (const auto &[module, realPath] : registered) {
+            if (module) {
+                Q_EMIT module->moduleRegistered(realPath);
+            }
+        }
+    };
+    QMetaObject::invokeMethod(QCoreApplication::instance(), registeredSignals, Qt::QueuedConnection);
+}
+
 QString KDEDModule::moduleName() const
 {
     return d->moduleName;
 }
 
-static const char s_modules_path[] = "/modules/";
+void KDEDModule::setChangeCoalescingInterval(int msec)
+{
+    d->flushTimer.setInterval(qMax(0, msec));
+}
+
+int KDEDModule::changeCoalescingInterval() const
+{
+    return d->flushTimer.interval();
+}
+
+void KDEDModule::notifyPropertyChanged(const QString &interface, const QString &property, const QVariant &value)
+{
+    d->changedProperties[interface].insert(property, value);
+    if (!d->flushTimer.isActive()) {
+        d->flushTimer.start();
+    }
+}
+
+void KDEDModule::emitCoalescedSignal(const QString &interface, const QString &name, const QVariantList &arguments)
+{
+    auto it = std::find_if(d->pendingSignals.begin(), d->pendingSignals.end(), [&interface, &name](const KDEDModulePrivate::PendingSignal &pending) {
+        return pending.name == name && pending.interface == interface;
+    });
+    if (it != d->pendingSignals.end()) {
+        it->arguments = arguments;
+    } else {
+        d->pendingSignals.append(KDEDModulePrivate::PendingSignal{interface, name, arguments});
+    }
+
+    if (!d->flushTimer.isActive()) {
+        d->flushTimer.start();
+    }
+}
+
+QDBusVariant KDEDModule::encodePayload(const QByteArray &data, const QDBusConnection &connection, qsizetype inlineThreshold)
+{
+    return KDBusPayload::pack(data, connection, inlineThreshold);
+}
+
+QByteArray KDEDModule::decodePayload(const QDBusVariant &payload, qsizetype maxSize)
+{
+    return KDBusPayload::unpack(payload, maxSize);
+}
+
+KDEDModule::MappedPayload KDEDModule::mapPayload(const QDBusVariant &payload, qsizetype maxSize)
+{
+    KDBusPayload::Mapping mapping = KDBusPayload::map(payload, maxSize);
+    return MappedPayload(std::move(mapping.owner), mapping.data);
+}
+
+bool KDEDModule::runAsync(const std::function<QDBusMessage(const QDBusMessage &)> &work)
+{
+    // Modules that make use of this inherit QDBusContext, which is not a QObject
+    auto context = dynamic_cast<QDBusContext *>(this);
+    if (!context || !context->calledFromDBus()) {
+        qCWarning(KDBUSADDONS_LOG) << "runAsync() needs to be called from a D-Bus call to a module inheriting QDBusContext, in" << d->moduleName;
+        return false;
+    }
+
+    const QDBusMessage request = context->message();
+    const QDBusConnection connection = context->connection();
+    context->setDelayedReply(true);
+
+    if (d->maxQueuedAsyncCalls >= 0 && d->queuedAsyncCalls >= d->maxQueuedAsyncCalls) {
+        qCDebug(KDBUSADDONS_LOG) << "Rejecting" << request.member() << "on" << d->moduleName << "-" << d->queuedAsyncCalls << "calls queued already";
+        connection.send(request.createErrorReply(QDBusError::LimitsExceeded, QStringLiteral("Too many calls queued, try again later")));
+        return true;
+    }
+
+    KDEDModulePrivate *priv = d.get();
+    ++priv->queuedAsyncCalls;
+    // The pool is waited for before the private goes away, see ~KDEDModule()
+    d->asyncPool.start([priv, work, request, connection]() {
+        --priv->queuedAsyncCalls;
+        if (priv->destroyed) {
+            if (request.isReplyRequired()) {
+                connection.send(request.createErrorReply(QDBusError::UnknownObject, QStringLiteral("The module was unloaded")));
+            }
+            return;
+        }
+        ++priv->activeAsyncCalls;
+
+        QDBusMessage reply = work(request);
+        if (reply.type() == QDBusMessage::InvalidMessage) {
+            reply = request.createReply();
+        }
+        if (request.isReplyRequired()) {
+            connection.send(reply);
+        }
+
+        --priv->activeAsyncCalls;
+    });
+    return true;
+}
+
+void KDEDModule::setMaxConcurrentAsyncCalls(int count)
+{
+    d->asyncPool.setMaxThreadCount(qMax(1, count));
+}
+
+int KDEDModule::maxConcurrentAsyncCalls() const
+{
+    return d->asyncPool.maxThreadCount();
+}
+
+void KDEDModule::setMaxQueuedAsyncCalls(int count)
+{
+    d->maxQueuedAsyncCalls = count;
+}
+
+int KDEDModule::maxQueuedAsyncCalls() const
+{
+    return d->maxQueuedAsyncCalls;
+}
+
+int KDEDModule::queuedAsyncCalls() const
+{
+    return d->queuedAsyncCalls;
+}
+
+int KDEDModule::activeAsyncCalls() const
+{
+    return d->activeAsyncCalls;
+}
+
+void KDEDModule::waitForAsyncCalls()
+{
+    d->asyncPool.waitForDone();
+}
+
+QString KDEDModule::enablePeerConnections()
+{
+    if (s_peerServer) {
+        return s_peerServer->server->address();
+    }
+
+    const QString runtimeDir = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    auto server = new QDBusServer(QLatin1String("unix:dir=") + runtimeDir, QCoreApplication::instance());
+    if (!server->isConnected()) {
+        qCWarning(KDBUSADDONS_LOG) << "Cannot listen for peer connections to kded modules:" << server->lastError().message();
+        delete server;
+        return QString();
+    }
+
+    s_peerServer = new KDEDModulePeerServer(server);
+    if (!QDBusConnection::sessionBus().registerVirtualObject(QStringLiteral("/modules"), s_peerServer)) {
+        qCWarning(KDBUSADDONS_LOG) << "Cannot register the discovery of peer connections to kded modules at /modules";
+    }
+
+    return server->address();
+}
+
+QDBusConnection KDEDModule::connectToPeer(const QString &service)
+{
+    QDBusConnection bus = QDBusConnection::sessionBus();
+
+    QDBusMessage message = QDBusMessage::createMethodCall(service, QStringLiteral("/modules"), QStringLiteral("org.kde.KDEDModulePeer"), QStringLiteral("Address"));
+    const QDBusReply<QString> reply = bus.call(message, QDBus::Block, 5000);
+    if (!reply.isValid()) {
+        qCDebug(KDBUSADDONS_LOG) << "No peer connection to" << service << "-" << reply.error().message();
+        return bus;
+    }
+
+    const QString name = QLatin1String("kdedmodule-peer:") + reply.value();
+    QDBusConnection existing(name);
+    if (existing.isConnected()) {
+        return existing;
+    }
+
+    QDBusConnection peer = QDBusConnection::connectToPeer(reply.value(), name);
+    if (!peer.isConnected()) {
+        qCDebug(KDBUSADDONS_LOG) << "Cannot connect to" << service << "directly:" << peer.lastError().message();
+        QDBusConnection::disconnectFromPeer(name);
+        return bus;
+    }
+    return peer;
+}
+
+void KDEDModule::registerWindow(qlonglong windowId)
+{
+    if (s_windowRegistry.windows.contains(windowId)) {
+        return;
+    }
+    s_windowRegistry.windows.insert(windowId);
+
+    // Unregistered and registered again before anyone was told is no change
+    if (!s_windowRegistry.removed.remove(windowId)) {
+        s_windowRegistry.added.insert(windowId);
+    }
+    s_windowRegistry.scheduleFlush();
+}
+
+void KDEDModule::unregisterWindow(qlonglong windowId)
+{
+    if (!s_windowRegistry.windows.remove(windowId)) {
+        return;
+    }
+
+    if (!s_windowRegistry.added.remove(windowId)) {
+        s_windowRegistry.removed.insert(windowId);
+    }
+    s_windowRegistry.scheduleFlush();
+}
+
+bool KDEDModule::isWindowRegistered(qlonglong windowId)
+{
+    return s_windowRegistry.windows.contains(windowId);
+}
+
+QList<qlonglong> KDEDModule::registeredWindows()
+{
+    return sortedWindows(s_windowRegistry.windows);
+}
 
 QString KDEDModule::moduleForMessage(const QDBusMessage &message)
 {
+    KDBUSADDONS_TRACE_SCOPE(KDEDModule_moduleForMessage, message.path());
+
     if (message.type() != QDBusMessage::MethodCallMessage) {
         return QString();
     }
@@ -101,4 +679,5 @@ QString KDEDModule::moduleForMessage(const QDBusMessage &message)
     return obj;
 }
 
+#include "kdedmodule.moc"
 #include "moc_kdedmodule.cpp"
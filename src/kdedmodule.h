@@ -11,14 +11,20 @@
 
 #include <kdbusaddons_export.h>
 
+#include <QByteArrayView>
 #include <QObject>
+#include <QStringList>
+#include <QVariant>
+#include <functional>
 #include <memory>
 
 class KDEDModulePrivate;
 class Kded;
 
+class QDBusConnection;
 class QDBusObjectPath;
 class QDBusMessage;
+class QDBusVariant;
 
 /**
  * \class KDEDModule kdedmodule.h <KDEDModule>
@@ -58,6 +64,254 @@ public:
 
     QString moduleName() const;
 
+    /**
+     * Sets the interval in milliseconds over which notifyPropertyChanged() and
+     * emitCoalescedSignal() coalesce changes.
+     *
+     * With the default of @c 0, the changes made until control returns to the
+     * event loop are coalesced.
+     *
+     * @since 6.12
+     */
+    void setChangeCoalescingInterval(int msec);
+
+    /**
+     * Returns the interval set with setChangeCoalescingInterval().
+     *
+     * @since 6.12
+     */
+    int changeCoalescingInterval() const;
+
+    /**
+     * Announces that @p property of @p interface changed to @p value.
+     *
+     * Rather than being announced right away, the change is buffered for the
+     * changeCoalescingInterval(), and a single
+     * @c org.freedesktop.DBus.Properties.PropertiesChanged signal per interface
+     * is emitted with all the properties that changed in that time. A property
+     * that changed several times is announced with its latest value.
+     *
+     * This keeps modules whose state changes frequently, say a device or
+     * network monitor, from waking up every subscriber on each change.
+     *
+     * Does nothing until the module is registered with setModuleName().
+     *
+     * @since 6.12
+     */
+    void notifyPropertyChanged(const QString &interface, const QString &property, const QVariant &value);
+
+    /**
+     * Emits the D-Bus signal @p name of @p interface from the module's object
+     * path, at most once per changeCoalescingInterval().
+     *
+     * If the same signal is emitted several times within the interval, only the
+     * last emission is sent, with its @p arguments, at the end of the interval.
+     * Only meant for signals announcing a state, where the latest one supersedes
+     * the earlier ones.
+     *
+     * Does nothing until the module is registered with setModuleName().
+     *
+     * @since 6.12
+     */
+    void emitCoalescedSignal(const QString &interface, const QString &name, const QVariantList &arguments);
+
+    /**
+     * Size in bytes above which encodePayload() passes data as a file descriptor by default.
+     *
+     * @since 6.12
+     */
+    static constexpr qsizetype defaultPayloadInlineThreshold = 64 * 1024;
+
+    /**
+     * Wraps @p data for returning it from, or passing it to, a D-Bus method
+     * with a @c v argument.
+     *
+     * Up to @p inlineThreshold bytes are passed inline as @c ay. Larger blobs,
+     * like thumbnails, indexes or log extracts, are written to a sealed memory
+     * file whose descriptor is passed as @c h instead, if @p connection supports
+     * passing file descriptors. The bus daemon then does not have to copy the
+     * data, and the receiver maps it instead of reading it from the message.
+     *
+     * @p connection is the one the data is sent on, usually the one of the
+     * current call. The receiver gets the data back with decodePayload() or mapPayload().
+     *
+     * @code
+     * QDBusVariant MyModule::thumbnail(const QString &path)
+     * {
+     *     return KDEDModule::encodePayload(loadThumbnail(path), QDBusConnection::sessionBus());
+     * }
+     * @endcode
+     *
+     * @since 6.12
+     */
+    static QDBusVariant encodePayload(const QByteArray &data, const QDBusConnection &connection, qsizetype inlineThreshold = defaultPayloadInlineThreshold);
+
+    /**
+     * Size in bytes above which decodePayload() and mapPayload() reject data passed
+     * as a file descriptor by default, so that a peer cannot make the receiver
+     * allocate or map arbitrary amounts of memory.
+     *
+     * @since 6.12
+     */
+    static constexpr qsizetype defaultPayloadMaxSize = 256 * 1024 * 1024;
+
+    /**
+     * Returns a copy of the data wrapped with encodePayload(), or a null QByteArray
+     * if @p payload holds neither @c ay nor the descriptor of a regular file that can be read, or
+     * if it holds more than @p maxSize bytes.
+     *
+     * @see mapPayload()
+     * @since 6.12
+     */
+    static QByteArray decodePayload(const QDBusVariant &payload, qsizetype maxSize = defaultPayloadMaxSize);
+
+    /**
+     * Read-only view of data returned by mapPayload().
+     *
+     * The data stays valid for as long as the view, or a copy of it, is around.
+     * Use toByteArray() to keep the data beyond that.
+     *
+     * @since 6.12
+     */
+    class MappedPayload
+    {
+    public:
+        /** Constructs a null view. */
+        MappedPayload() = default;
+
+        /** Returns @c true unless this view is null. */
+        explicit operator bool() const
+        {
+            return bool(m_owner);
+        }
+
+        /** Returns the data, which is only valid while this view exists. */
+        QByteArrayView data() const
+        {
+            return m_data;
+        }
+
+        /** Returns a copy of the data that does not depend on this view. */
+        QByteArray toByteArray() const
+        {
+            return m_data.toByteArray();
+        }
+
+    private:
+        friend class KDEDModule;
+        MappedPayload(std::shared_ptr<const void> owner, QByteArrayView data)
+            : m_owner(std::move(owner))
+            , m_data(data)
+        {
+        }
+
+        std::shared_ptr<const void> m_owner;
+        QByteArrayView m_data;
+    };
+
+    /**
+     * Returns the data wrapped with encodePayload() without copying it, or a null
+     * view in the same cases as decodePayload().
+     *
+     * Data passed in a sealed memory file is mapped, and stays mapped for as long
+     * as the returned view, or a copy of it, is around. Files that are not sealed
+     * against writing and shrinking could change while mapped, and are read
+     * instead. Descriptors of anything but regular files are rejected.
+     *
+     * @code
+     * const KDEDModule::MappedPayload index = KDEDModule::mapPayload(reply.value());
+     * if (index) {
+     *     parseIndex(index.data());
+     * }
+     * @endcode
+     *
+     * @since 6.12
+     */
+    static MappedPayload mapPayload(const QDBusVariant &payload, qsizetype maxSize = defaultPayloadMaxSize);
+
+    /**
+     * Handles the D-Bus call currently being processed on a worker thread.
+     *
+     * Slots doing file I/O or heavy computation would otherwise block the whole
+     * daemon, and with it every other module. Such a slot calls this with the
+     * actual work and returns right away, its return value is ignored. The reply
+     * is delayed until @p work has run on the module's thread pool, and is the
+     * message @p work returns for the call it is given, for example
+     * @c request.createReply(result). An invalid message results in an empty reply.
+     *
+     * Needs to be called from a slot called through D-Bus of a module that
+     * inherits QDBusContext publicly, returns @c false otherwise.
+     *
+     * @p work is run in another thread, it must not touch the module or other
+     * objects of the main thread without synchronization. Calls still waiting for
+     * a thread when the module is destroyed are answered with an error without
+     * running their work. As the members of a subclass are gone by then, modules
+     * whose work uses their own members should call waitForAsyncCalls() in their
+     * destructor for the calls running at that moment.
+     *
+     * @code
+     * QString MyModule::checksum(const QString &path)
+     * {
+     *     runAsync([path](const QDBusMessage &request) {
+     *         return request.createReply(computeChecksum(path));
+     *     });
+     *     return QString();
+     * }
+     * @endcode
+     *
+     * @see setMaxConcurrentAsyncCalls(), setMaxQueuedAsyncCalls()
+     * @since 6.12
+     */
+    bool runAsync(const std::function<QDBusMessage(const QDBusMessage &request)> &work);
+
+    /**
+     * Sets how many calls passed to runAsync() may run at the same time. The default is @c 1.
+     *
+     * @since 6.12
+     */
+    void setMaxConcurrentAsyncCalls(int count);
+
+    /**
+     * @since 6.12
+     */
+    int maxConcurrentAsyncCalls() const;
+
+    /**
+     * Sets how many calls passed to runAsync() may wait for a thread. Further calls
+     * are answered with an @c org.freedesktop.DBus.Error.LimitsExceeded error.
+     *
+     * The default of @c -1 lets any number of calls wait.
+     *
+     * @since 6.12
+     */
+    void setMaxQueuedAsyncCalls(int count);
+
+    /**
+     * @since 6.12
+     */
+    int maxQueuedAsyncCalls() const;
+
+    /**
+     * Returns the number of calls passed to runAsync() waiting for a thread.
+     *
+     * @since 6.12
+     */
+    int queuedAsyncCalls() const;
+
+    /**
+     * Returns the number of calls passed to runAsync() running at the moment.
+     *
+     * @since 6.12
+     */
+    int activeAsyncCalls() const;
+
+    /**
+     * Waits until all calls passed to runAsync() have been handled.
+     *
+     * @since 6.12
+     */
+    void waitForAsyncCalls();
+
     /**
      * Returns the module being called by this D-Bus message.
      * Useful for autoloading modules in kded and similar daemons.
@@ -65,17 +319,135 @@ public:
      */
     static QString moduleForMessage(const QDBusMessage &message);
 
+    /**
+     * Sets the names of many modules at once, registering them to D-Bus.
+     *
+     * This is the same as calling setModuleName() for each module with the name
+     * at the same index in @p names, but meant for daemons loading many modules
+     * on startup: moduleRegistered() is emitted for all of them from a single
+     * event, rather than from one event per module.
+     *
+     * @p modules and @p names must have the same size. Null modules are skipped,
+     * as are modules listed more than once after their first occurrence.
+     *
+     * @since 6.12
+     */
+    static void registerModules(const QList<KDEDModule *> &modules, const QStringList &names);
+
+    /**
+     * Lets clients of the modules of this process connect to it directly,
+     * rather than through the bus daemon.
+     *
+     * For clients calling modules thousands of times per second, the bus daemon
+     * routing every call roughly doubles the latency. This listens on a private
+     * socket in the user's runtime directory, on which every module registered
+     * with setModuleName() is exported as on the bus. Clients find the address
+     * of the socket with the @c Address method of the @c org.kde.KDEDModulePeer
+     * interface at @c /modules, and connectToPeer() does it all for them.
+     *
+     * Meant to be called once by the daemon hosting the modules. Returns the
+     * address of the socket, or an empty string if it could not be created.
+     *
+     * @since 6.12
+     */
+    static QString enablePeerConnections();
+
+    /**
+     * Returns a connection for calling the modules of the daemon owning @p service,
+     * for example @c org.kde.kded6.
+     *
+     * This is a direct connection to the daemon if it called enablePeerConnections(),
+     * and the session bus otherwise. Either way, the modules can be called on it
+     * at @c /modules/<name>. The destination of calls does not matter on direct
+     * connections, so calls can be made the same way on both.
+     *
+     * @since 6.12
+     */
+    static QDBusConnection connectToPeer(const QString &service);
+
+    /**
+     * Adds @p windowId to the windows registered in this process.
+     *
+     * The daemon hosting the modules keeps track of the main windows of the
+     * session with this, so that modules don't each have to. All modules are
+     * told about the windows registered until control returns to the event
+     * loop with one windowsRegistered() signal, rather than one signal per window.
+     *
+     * Registering a window that is registered already does nothing. Without
+     * a QCoreApplication the modules are told right away.
+     *
+     * Must be called from the main thread.
+     *
+     * @since 6.12
+     */
+    static void registerWindow(qlonglong windowId);
+
+    /**
+     * Removes @p windowId from the windows registered in this process.
+     *
+     * Like registerWindow(), this is announced with windowsUnregistered() from
+     * the event loop. A window registered and unregistered again in the meantime
+     * is not announced at all.
+     *
+     * Must be called from the main thread.
+     *
+     * @since 6.12
+     */
+    static void unregisterWindow(qlonglong windowId);
+
+    /**
+     * Returns whether @p windowId is registered with registerWindow().
+     *
+     * @since 6.12
+     */
+    static bool isWindowRegistered(qlonglong windowId);
+
+    /**
+     * Returns all windows registered with registerWindow(), in ascending order.
+     *
+     * @since 6.12
+     */
+    static QList<qlonglong> registeredWindows();
+
 Q_SIGNALS:
     /**
      * Emitted when a mainwindow registers itself.
+     *
+     * The daemon emits this for the windows registered with it over D-Bus.
+     * Since 6.12 it is also emitted for each window in windowsRegistered(),
+     * right after that signal, so modules connected to it only keep seeing
+     * all windows. New code should prefer windowsRegistered().
      */
     void windowRegistered(qlonglong windowId);
 
     /**
      * Emitted when a mainwindow unregisters itself.
+     *
+     * Like windowRegistered(), since 6.12 this is also emitted for each window
+     * in windowsUnregistered(), right after that signal.
      */
     void windowUnregistered(qlonglong windowId);
 
+    /**
+     * Emitted when windows have been registered with registerWindow().
+     *
+     * @p windowIds holds all windows registered since the last emission, in ascending order.
+     * Windows the daemon only announces with windowRegistered() are not included.
+     *
+     * @since 6.12
+     */
+    void windowsRegistered(const QList<qlonglong> &windowIds);
+
+    /**
+     * Emitted when windows have been unregistered with unregisterWindow().
+     *
+     * @p windowIds holds all windows unregistered since the last emission, in ascending order.
+     * It is emitted before windowsRegistered() if both are due.
+     *
+     * @since 6.12
+     */
+    void windowsUnregistered(const QList<qlonglong> &windowIds);
+
     /**
      * Emitted after the module is registered successfully with D-Bus
      *
@@ -0,0 +1,202 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include "klaunchenvironment.h"
+#include "klaunchenvironment_p.h"
+
+#include <QCoreApplication>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+#include <QPointer>
+
+#include "kdbusaddons_debug.h"
+
+static const QLatin1String s_systemdService("org.freedesktop.systemd1");
+static const QLatin1String s_systemdPath("/org/freedesktop/systemd1");
+static const QLatin1String s_managerInterface("org.freedesktop.systemd1.Manager");
+static const QLatin1String s_propertiesInterface("org.freedesktop.DBus.Properties");
+static const QLatin1String s_environmentProperty("Environment");
+
+static std::atomic<KLaunchEnvironmentPrivate *> s_instance = nullptr;
+
+// Properties arrive demarshalled or not, depending on how they were read
+static QStringList toStringList(const QVariant &value)
+{
+    if (value.metaType() == QMetaType::fromType<QDBusArgument>()) {
+        return qdbus_cast<QStringList>(value.value<QDBusArgument>());
+    }
+    return value.toStringList();
+}
+
+KLaunchEnvironmentPrivate::KLaunchEnvironmentPrivate(KLaunchEnvironment *q)
+    : q(q)
+{
+    store(std::make_shared<const QProcessEnvironment>());
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    bus.connect(s_systemdService,
+                s_systemdPath,
+                s_propertiesInterface,
+                QStringLiteral("PropertiesChanged"),
+                this,
+                SLOT(propertiesChanged(QString, QVariantMap, QStringList)));
+
+    // The manager of a new session may come up after us
+    watcher = new QDBusServiceWatcher(s_systemdService, bus, QDBusServiceWatcher::WatchForRegistration, this);
+    connect(watcher, &QDBusServiceWatcher::serviceRegistered, this, &KLaunchEnvironmentPrivate::load);
+}
+
+KLaunchEnvironmentPrivate *KLaunchEnvironmentPrivate::existingInstance()
+{
+    return s_instance;
+}
+
+std::shared_ptr<const QProcessEnvironment> KLaunchEnvironmentPrivate::snapshot() const
+{
+#ifdef __cpp_lib_atomic_shared_ptr
+    return environment.load();
+#else
+    QMutexLocker locker(&environmentMutex);
+    return environment;
+#endif
+}
+
+void KLaunchEnvironmentPrivate::store(const std::shared_ptr<const QProcessEnvironment> &newEnvironment)
+{
+#ifdef __cpp_lib_atomic_shared_ptr
+    environment.store(newEnvironment);
+#else
+    QMutexLocker locker(&environmentMutex);
+    environment = newEnvironment;
+#endif
+}
+
+void KLaunchEnvironmentPrivate::load()
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(s_systemdService, s_systemdPath, s_propertiesInterface, QStringLiteral("Get"));
+    message.setArguments({s_managerInterface, s_environmentProperty});
+
+    auto *callWatcher = new QDBusPendingCallWatcher(QDBusConnection::sessionBus().asyncCall(message), this);
+    connect(callWatcher, &QDBusPendingCallWatcher::finished, this, [this](QDBusPendingCallWatcher *callWatcher) {
+        callWatcher->deleteLater();
+        const QDBusPendingReply<QDBusVariant> reply = *callWatcher;
+        if (reply.isError()) {
+            qCDebug(KDBUSADDONS_LOG) << "Could not read the launch environment:" << reply.error().message();
+            return;
+        }
+        setEnvironment(toStringList(reply.value().variant()));
+    });
+}
+
+void KLaunchEnvironmentPrivate::setEnvironment(const QStringList &assignments)
+{
+    auto newEnvironment = std::make_shared<QProcessEnvironment>();
+    for (const QString &assignment : assignments) {
+        const qsizetype separator = assignment.indexOf(QLatin1Char('='));
+        if (separator > 0) {
+            newEnvironment->insert(assignment.left(separator), assignment.mid(separator + 1));
+        }
+    }
+
+    const bool wasLoaded = loaded.exchange(true);
+    if (wasLoaded && *newEnvironment == *snapshot()) {
+        return;
+    }
+    store(newEnvironment);
+    Q_EMIT q->changed();
+}
+
+void KLaunchEnvironmentPrivate::applyUpdate(const QMap<QString, QString> &set, const QStringList &unset)
+{
+    // Until loaded, the update arrives with the whole environment
+    if (!loaded) {
+        return;
+    }
+
+    auto newEnvironment = std::make_shared<QProcessEnvironment>(*snapshot());
+    for (const QString &name : unset) {
+        newEnvironment->remove(name);
+    }
+    for (auto it = set.cbegin(); it != set.cend(); ++it) {
+        newEnvironment->insert(it.key(), it.value());
+    }
+
+    if (*newEnvironment != *snapshot()) {
+        store(newEnvironment);
+        Q_EMIT q->changed();
+    }
+}
+
+void KLaunchEnvironmentPrivate::propertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated)
+{
+    if (interface != s_managerInterface) {
+        return;
+    }
+
+    const auto it = changed.constFind(s_environmentProperty);
+    if (it != changed.cend()) {
+        setEnvironment(toStringList(*it));
+    } else if (invalidated.contains(s_environmentProperty)) {
+        load();
+    }
+}
+
+KLaunchEnvironment *KLaunchEnvironment::self()
+{
+    // Goes away with the application, the next one gets a new instance
+    static QPointer<KLaunchEnvironment> instance;
+    if (!instance) {
+        instance = new KLaunchEnvironment;
+        instance->setParent(QCoreApplication::instance());
+    }
+    return instance;
+}
+
+KLaunchEnvironment::KLaunchEnvironment()
+    : d(new KLaunchEnvironmentPrivate(this))
+{
+    s_instance = d.get();
+    d->load();
+}
+
+KLaunchEnvironment::~KLaunchEnvironment()
+{
+    s_instance = nullptr;
+}
+
+bool KLaunchEnvironment::isLoaded() const
+{
+    return d->loaded;
+}
+
+QProcessEnvironment KLaunchEnvironment::environment() const
+{
+    return *d->snapshot();
+}
+
+QString KLaunchEnvironment::value(const QString &name, const QString &defaultValue) const
+{
+    return d->snapshot()->value(name, defaultValue);
+}
+
+bool KLaunchEnvironment::contains(const QString &name) const
+{
+    return d->snapshot()->contains(name);
+}
+
+void KLaunchEnvironment::reload()
+{
+    d->load();
+}
+
+#include "moc_klaunchenvironment.cpp"
+#include "moc_klaunchenvironment_p.cpp"
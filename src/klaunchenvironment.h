@@ -0,0 +1,109 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KLAUNCHENVIRONMENT_H
+#define KLAUNCHENVIRONMENT_H
+
+#include <kdbusaddons_export.h>
+
+#include <QObject>
+#include <QProcessEnvironment>
+
+#include <memory>
+
+class KLaunchEnvironmentPrivate;
+
+/**
+ * @class KLaunchEnvironment klaunchenvironment.h <KLaunchEnvironment>
+ *
+ * Read access to the launch environment of the session.
+ *
+ * This keeps a copy of the environment of the systemd user manager, which is
+ * the environment units and applications of the session are launched with,
+ * so reading it is cheap.
+ *
+ * The systemd user manager does not announce changes of its environment. The
+ * copy is read on first use, when the manager starts, on reload(), and
+ * whenever a KUpdateLaunchEnvironmentJob of this process updates the manager.
+ * Changes made by other processes in between only show up with the next read.
+ * So the copy is not meant for deciding whether to update a variable,
+ * KUpdateLaunchEnvironmentJob leaves out updates that change nothing by itself.
+ *
+ * @code
+ * auto launchEnvironment = KLaunchEnvironment::self();
+ * connect(launchEnvironment, &KLaunchEnvironment::changed, this, [this, launchEnvironment]() {
+ *     applyPlatformTheme(launchEnvironment->value(QStringLiteral("QT_QPA_PLATFORMTHEME")));
+ * });
+ * @endcode
+ *
+ * @see KUpdateLaunchEnvironmentJob
+ * @since 6.12
+ */
+class KDBUSADDONS_EXPORT KLaunchEnvironment : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Returns the instance of this process, which is created and starts loading
+     * the environment on first use. It is deleted along with the QCoreApplication.
+     *
+     * Calls to this must be made from the main thread. The getters can be called
+     * from any thread. They do not wait for updates of the copy, but copying the
+     * pointer to the current snapshot may take a short lock.
+     */
+    static KLaunchEnvironment *self();
+
+    ~KLaunchEnvironment() override;
+
+    /**
+     * Returns whether the environment has been loaded.
+     *
+     * Until then, environment() is empty. There is nothing to load if the session
+     * is not managed by systemd.
+     */
+    bool isLoaded() const;
+
+    /**
+     * Returns a snapshot of the launch environment.
+     */
+    QProcessEnvironment environment() const;
+
+    /**
+     * Returns the value of @p name in the launch environment, or @p defaultValue if it is not set.
+     */
+    QString value(const QString &name, const QString &defaultValue = QString()) const;
+
+    /**
+     * Returns whether @p name is set in the launch environment.
+     */
+    bool contains(const QString &name) const;
+
+    /**
+     * Reads the environment from the systemd user manager again, to pick up the
+     * changes made by other processes since the copy was last read.
+     *
+     * Returns right away, changed() is emitted if the environment differs.
+     * Must be called from the main thread.
+     */
+    void reload();
+
+Q_SIGNALS:
+    /**
+     * Emitted in the main thread whenever the environment has been loaded or has changed.
+     */
+    void changed();
+
+private:
+    KDBUSADDONS_NO_EXPORT KLaunchEnvironment();
+
+    friend class KLaunchEnvironmentPrivate;
+    std::unique_ptr<KLaunchEnvironmentPrivate> const d;
+};
+
+#endif
@@ -0,0 +1,65 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KLAUNCHENVIRONMENT_P_H
+#define KLAUNCHENVIRONMENT_P_H
+
+#include "klaunchenvironment.h"
+
+#include <QMap>
+#include <QMutex>
+#include <QStringList>
+#include <QVariantMap>
+
+#include <atomic>
+#include <memory>
+
+class QDBusServiceWatcher;
+
+class KLaunchEnvironmentPrivate : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit KLaunchEnvironmentPrivate(KLaunchEnvironment *q);
+
+    // Returns the private of KLaunchEnvironment::self() if that was called already, without creating it
+    static KLaunchEnvironmentPrivate *existingInstance();
+
+    std::shared_ptr<const QProcessEnvironment> snapshot() const;
+
+    // Fetches the whole environment from the systemd user manager
+    void load();
+
+    // Replaces the copy with the @p assignments read from the systemd user manager
+    void setEnvironment(const QStringList &assignments);
+
+    // Applies an update the systemd user manager has confirmed
+    void applyUpdate(const QMap<QString, QString> &set, const QStringList &unset);
+
+    std::atomic<bool> loaded = false;
+
+private Q_SLOTS:
+    void propertiesChanged(const QString &interface, const QVariantMap &changed, const QStringList &invalidated);
+
+private:
+    void store(const std::shared_ptr<const QProcessEnvironment> &environment);
+
+    KLaunchEnvironment *const q;
+    QDBusServiceWatcher *watcher = nullptr;
+
+    // Readers never wait for writers to build a snapshot, only for the pointer to it to be copied
+#ifdef __cpp_lib_atomic_shared_ptr
+    std::atomic<std::shared_ptr<const QProcessEnvironment>> environment;
+#else
+    mutable QMutex environmentMutex;
+    std::shared_ptr<const QProcessEnvironment> environment;
+#endif
+};
+
+#endif
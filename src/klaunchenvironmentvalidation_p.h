@@ -0,0 +1,101 @@
+/*
+    This file is part of libkdbusaddons
+
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#ifndef KLAUNCHENVIRONMENTVALIDATION_P_H
+#define KLAUNCHENVIRONMENTVALIDATION_P_H
+
+#include <QStringView>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * Checks of environment variables before uploading them to the launch
+ * environment. They work on the UTF-16 data directly and don't allocate.
+ */
+namespace KLaunchEnvironmentValidation
+{
+inline bool isAsciiLetter(char16_t c)
+{
+    return (c >= u'a' && c <= u'z') || (c >= u'A' && c <= u'Z');
+}
+
+/*
+ * Whether @p name is a valid variable name.
+ *
+ * Posix says characters like % should be 'tolerated', but it gives issues in practice.
+ * https://bugzilla.redhat.com/show_bug.cgi?id=1754395
+ * https://bugzilla.redhat.com/show_bug.cgi?id=1879216
+ * Ensure systemd compat by only allowing ASCII alphanumerics and _ in names,
+ * with no digit first.
+ */
+inline bool isPosixName(QStringView name)
+{
+    if (name.isEmpty()) {
+        return false;
+    }
+
+    const char16_t *data = name.utf16();
+    if (!isAsciiLetter(data[0]) && data[0] != u'_') {
+        return false;
+    }
+    for (qsizetype i = 1; i < name.size(); ++i) {
+        const char16_t c = data[i];
+        if (!isAsciiLetter(c) && !(c >= u'0' && c <= u'9') && c != u'_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Whether systemd accepts @p value as the value of a variable.
+ *
+ * systemd code checks that a value contains no control characters except \n \t,
+ * effectively copied from systemd's string_has_cc. NUL is let through, as always.
+ */
+inline bool isSystemdApprovedValue(QStringView value)
+{
+    const char16_t *data = value.utf16();
+    const qsizetype size = value.size();
+    qsizetype i = 0;
+
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lastControl = _mm_set1_epi16(0x1f);
+    const __m128i tab = _mm_set1_epi16(u'\t');
+    const __m128i newline = _mm_set1_epi16(u'\n');
+    const __m128i del = _mm_set1_epi16(0x7f);
+
+    for (; i + 8 <= size; i += 8) {
+        const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        // Unsigned chars <= 0x1f, SSE2 only compares signed
+        const __m128i control = _mm_cmpeq_epi16(_mm_subs_epu16(chars, lastControl), zero);
+        const __m128i allowed = _mm_or_si128(_mm_cmpeq_epi16(chars, zero), _mm_or_si128(_mm_cmpeq_epi16(chars, tab), _mm_cmpeq_epi16(chars, newline)));
+        const __m128i rejected = _mm_or_si128(_mm_andnot_si128(allowed, control), _mm_cmpeq_epi16(chars, del));
+        if (_mm_movemask_epi8(rejected) != 0) {
+            return false;
+        }
+    }
+#endif
+
+    for (; i < size; ++i) {
+        const char16_t c = data[i];
+        if (c == u'\n' || c == u'\t') {
+            continue;
+        }
+        if ((c > 0 && c < u' ') || c == 0x7f) {
+            return false;
+        }
+    }
+    return true;
+}
+}
+
+#endif
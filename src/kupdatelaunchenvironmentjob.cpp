@@ -7,80 +7,253 @@
 
 #include "kupdatelaunchenvironmentjob.h"
 
+#include <QCoreApplication>
 #include <QDBusArgument>
 #include <QDBusConnection>
 #include <QDBusMetaType>
 #include <QDBusPendingReply>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
 
+#include <QMutex>
+#include <QPointer>
+#include <QSet>
 #include <QTimer>
 
+#include <functional>
+#include <memory>
+
 #include "kdbusaddons_debug.h"
+#include "kdbusaddons_trace_p.h"
+#include "klaunchenvironment_p.h"
+#include "klaunchenvironmentvalidation_p.h"
 
 class KUpdateLaunchEnvironmentJobPrivate
 {
 public:
-    explicit KUpdateLaunchEnvironmentJobPrivate(KUpdateLaunchEnvironmentJob *q);
-    void monitorReply(const QDBusPendingReply<> &reply);
+    QProcessEnvironment environment;
+    QStringList unsetVariables;
+    bool deferredDelivery = false;
+};
 
-    static bool isPosixName(const QString &name);
-    static bool isSystemdApprovedValue(const QString &value);
+// How long updates are collected before going out together
+static const int s_flushWindow = 10;
 
-    KUpdateLaunchEnvironmentJob *q;
-    QProcessEnvironment environment;
-    int pendingReplies = 0;
+// Merges the updates of all jobs of the process started within a short time
+// into one round of messages to the targets, the last update of a variable winning.
+class KLaunchEnvironmentUpdater : public QObject
+{
+    Q_OBJECT
+public:
+    static KLaunchEnvironmentUpdater *instance();
+
+    // Adds @p environment and @p unsetVariables to the next flush, @p done is called in
+    // the thread of @p context once that has completed. Safe to call from any thread.
+    void update(const QProcessEnvironment &environment,
+                const QStringList &unsetVariables,
+                bool deferredDelivery,
+                QObject *context,
+                std::function<void()> &&done);
+
+private:
+    // The updates sent together, and who is waiting for them
+    struct Flush {
+        int pendingReplies = 0;
+        QList<std::pair<QPointer<QObject>, std::function<void()>>> waiting;
+    };
+
+    KLaunchEnvironmentUpdater();
+
+    void enqueue(const QProcessEnvironment &environment,
+                 const QStringList &unsetVariables,
+                 bool deferredDelivery,
+                 QObject *context,
+                 std::function<void()> &&done);
+    void flush();
+    // Updates of the variables in @p deferred are kept for when the target registers if it is not on the bus
+    void sendToPlasmaSession(const std::shared_ptr<Flush> &flush, QMap<QString, QString> environment, QSet<QString> deferred);
+    void sendToSystemd(const std::shared_ptr<Flush> &flush, QMap<QString, QString> environment, QSet<QString> unset, QSet<QString> deferred);
+    void setSystemdEnvironment(const std::shared_ptr<Flush> &flush, const QMap<QString, QString> &environment, const QSet<QString> &unset, const QSet<QString> &deferred);
+    void deliverDeferred(const QString &target);
+    // @p handled is called with the error of the reply, which is invalid if the target accepted the update
+    void monitorReply(const std::shared_ptr<Flush> &flush,
+                      const QString &target,
+                      const QDBusPendingReply<> &reply,
+                      std::function<void(const QDBusError &)> &&handled = {});
+
+    QMap<QString, QString> pendingEnvironment;
+    QSet<QString> pendingUnset;
+    // The variables whose last update asked for deferred delivery
+    QSet<QString> pendingDeferred;
+    QList<std::pair<QPointer<QObject>, std::function<void()>>> waiting;
+    QTimer flushTimer;
+
+    // Updates for targets that were not on the bus yet
+    QMap<QString, QString> deferredPlasmaSessionEnvironment;
+    QMap<QString, QString> deferredSystemdEnvironment;
+    QSet<QString> deferredSystemdUnset;
+    QDBusServiceWatcher deferredWatcher;
 };
 
-KUpdateLaunchEnvironmentJobPrivate::KUpdateLaunchEnvironmentJobPrivate(KUpdateLaunchEnvironmentJob *q)
-    : q(q)
+static const QLatin1String s_plasmaSessionService("org.kde.Startup");
+static const QLatin1String s_systemdService("org.freedesktop.systemd1");
+
+// Whether a call failed because nobody owns the name it was sent to
+static bool isTargetAbsent(const QDBusError &error)
 {
+    return error.type() == QDBusError::ServiceUnknown || error.type() == QDBusError::NameHasNoOwner;
 }
 
-void KUpdateLaunchEnvironmentJobPrivate::monitorReply(const QDBusPendingReply<> &reply)
+static QMutex s_updaterMutex;
+static KLaunchEnvironmentUpdater *s_updater = nullptr;
+
+static void deleteUpdater()
 {
-    ++pendingReplies;
+    QMutexLocker locker(&s_updaterMutex);
+    delete std::exchange(s_updater, nullptr);
+}
 
-    auto *watcher = new QDBusPendingCallWatcher(reply, q);
-    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, q, [this](QDBusPendingCallWatcher *watcher) {
-        watcher->deleteLater();
-        --pendingReplies;
+KLaunchEnvironmentUpdater *KLaunchEnvironmentUpdater::instance()
+{
+    // Whichever thread starts the first job, the updater lives on the main thread,
+    // where its timers and bus replies are handled. It goes away with the application,
+    // the next one gets a new updater.
+    QMutexLocker locker(&s_updaterMutex);
+    if (!s_updater) {
+        s_updater = new KLaunchEnvironmentUpdater;
+        s_updater->moveToThread(QCoreApplication::instance()->thread());
+        qAddPostRoutine(deleteUpdater);
+    }
+    return s_updater;
+}
+
+KLaunchEnvironmentUpdater::KLaunchEnvironmentUpdater()
+    : flushTimer(this)
+    , deferredWatcher(this)
+{
+    qDBusRegisterMetaType<QMap<QString, QString>>();
+
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(s_flushWindow);
+    connect(&flushTimer, &QTimer::timeout, this, &KLaunchEnvironmentUpdater::flush);
+
+    deferredWatcher.setConnection(QDBusConnection::sessionBus());
+    deferredWatcher.setWatchMode(QDBusServiceWatcher::WatchForRegistration);
+    connect(&deferredWatcher, &QDBusServiceWatcher::serviceRegistered, this, &KLaunchEnvironmentUpdater::deliverDeferred);
 
-        if (pendingReplies == 0) {
-            Q_EMIT q->finished();
-            q->deleteLater();
-        }
-    });
 }
 
-KUpdateLaunchEnvironmentJob::KUpdateLaunchEnvironmentJob(const QProcessEnvironment &environment)
-    : d(new KUpdateLaunchEnvironmentJobPrivate(this))
+void KLaunchEnvironmentUpdater::update(const QProcessEnvironment &environment,
+                                       const QStringList &unsetVariables,
+                                       bool deferredDelivery,
+                                       QObject *context,
+                                       std::function<void()> &&done)
 {
-    d->environment = environment;
-    QTimer::singleShot(0, this, &KUpdateLaunchEnvironmentJob::start);
+    QMetaObject::invokeMethod(
+        this,
+        [this, environment, unsetVariables, deferredDelivery, context = QPointer<QObject>(context), done = std::move(done)]() mutable {
+            enqueue(environment, unsetVariables, deferredDelivery, context, std::move(done));
+        },
+        Qt::QueuedConnection);
 }
 
-KUpdateLaunchEnvironmentJob::~KUpdateLaunchEnvironmentJob() = default;
+void KLaunchEnvironmentUpdater::enqueue(const QProcessEnvironment &environment,
+                                        const QStringList &unsetVariables,
+                                        bool deferredDelivery,
+                                        QObject *context,
+                                        std::function<void()> &&done)
+{
+    const QStringList setVariables = environment.keys();
+    for (const auto &varName : unsetVariables) {
+        pendingEnvironment.remove(varName);
+        pendingUnset.insert(varName);
+    }
+    for (const auto &varName : setVariables) {
+        pendingEnvironment.insert(varName, environment.value(varName));
+        pendingUnset.remove(varName);
+    }
+    for (const auto &varName : unsetVariables + setVariables) {
+        if (deferredDelivery) {
+            pendingDeferred.insert(varName);
+        } else {
+            pendingDeferred.remove(varName);
+        }
+    }
+    waiting.append({context, std::move(done)});
 
-void KUpdateLaunchEnvironmentJob::start()
+    // Watch before sending, so a target registering right after the failed call is not missed
+    if (deferredDelivery) {
+        if (deferredWatcher.watchedServices().isEmpty()) {
+            deferredWatcher.setWatchedServices({s_plasmaSessionService, s_systemdService});
+        }
+    }
+
+    if (!flushTimer.isActive()) {
+        flushTimer.start();
+    }
+}
+
+void KLaunchEnvironmentUpdater::monitorReply(const std::shared_ptr<Flush> &flush,
+                                             const QString &target,
+                                             const QDBusPendingReply<> &reply,
+                                             std::function<void(const QDBusError &)> &&handled)
 {
-    qDBusRegisterMetaType<QMap<QString, QString>>();
+    ++flush->pendingReplies;
+
+    auto *watcher = new QDBusPendingCallWatcher(reply, this);
+    QObject::connect(watcher, &QDBusPendingCallWatcher::finished, this, [flush, target, handled](QDBusPendingCallWatcher *watcher) {
+        KDBUSADDONS_TRACE(KUpdateLaunchEnvironmentJob_reply, target, watcher->isError());
+        watcher->deleteLater();
+        --flush->pendingReplies;
+
+        if (handled) {
+            handled(watcher->error());
+        }
+
+        if (flush->pendingReplies == 0) {
+            // Each job hears back in its own thread
+            for (const auto &[context, done] : std::as_const(flush->waiting)) {
+                if (context) {
+                    QMetaObject::invokeMethod(context.data(), done);
+                }
+            }
+        }
+    });
+}
+
+void KLaunchEnvironmentUpdater::flush()
+{
+    auto flush = std::make_shared<Flush>();
+    flush->waiting = std::exchange(waiting, {});
+    const QSet<QString> deferred = std::exchange(pendingDeferred, {});
+    const QMap<QString, QString> environment = std::exchange(pendingEnvironment, {});
+    const QSet<QString> unset = std::exchange(pendingUnset, {});
+
+    QMap<QString, QString> plasmaSessionEnv;
     QMap<QString, QString> dbusActivationEnv;
-    QStringList systemdUpdates;
+    QMap<QString, QString> systemdEnv;
+    QSet<QString> systemdUnset;
 
-    for (const auto &varName : d->environment.keys()) {
-        if (!KUpdateLaunchEnvironmentJobPrivate::isPosixName(varName)) {
+    // Neither plasma-session nor the D-Bus activation environment can unset variables,
+    // only systemd has a way to do it.
+    for (const QString &varName : unset) {
+        if (!KLaunchEnvironmentValidation::isPosixName(varName)) {
+            qCWarning(KDBUSADDONS_LOG) << "Skipping unsetting of environment variable " << varName << "as name contains unsupported characters";
+            continue;
+        }
+        systemdUnset.insert(varName);
+    }
+
+    for (auto it = environment.cbegin(); it != environment.cend(); ++it) {
+        const QString &varName = it.key();
+        if (!KLaunchEnvironmentValidation::isPosixName(varName)) {
             qCWarning(KDBUSADDONS_LOG) << "Skipping syncing of environment variable " << varName << "as name contains unsupported characters";
             continue;
         }
-        const QString value = d->environment.value(varName);
+        const QString &value = it.value();
 
         // plasma-session
-        QDBusMessage plasmaSessionMsg = QDBusMessage::createMethodCall(QStringLiteral("org.kde.Startup"),
-                                                                       QStringLiteral("/Startup"),
-                                                                       QStringLiteral("org.kde.Startup"),
-                                                                       QStringLiteral("updateLaunchEnv"));
-        plasmaSessionMsg.setArguments({QVariant::fromValue(varName), QVariant::fromValue(value)});
-        auto plasmaSessionReply = QDBusConnection::sessionBus().asyncCall(plasmaSessionMsg);
-        d->monitorReply(plasmaSessionReply);
+        plasmaSessionEnv.insert(varName, value);
 
         // DBus-activation environment
         dbusActivationEnv.insert(varName, value);
@@ -89,70 +262,238 @@ void KUpdateLaunchEnvironmentJob::start()
         // Systemd has stricter parsing of valid environment variables
         // https://github.com/systemd/systemd/issues/16704
         // validate here
-        if (!KUpdateLaunchEnvironmentJobPrivate::isSystemdApprovedValue(value)) {
+        if (!KLaunchEnvironmentValidation::isSystemdApprovedValue(value)) {
             qCWarning(KDBUSADDONS_LOG) << "Skipping syncing of environment variable " << varName << "as value contains unsupported characters";
             continue;
         }
-        const QString updateString = varName + QStringLiteral("=") + value;
-        systemdUpdates.append(updateString);
+        systemdEnv.insert(varName, value);
     }
 
+    sendToPlasmaSession(flush, plasmaSessionEnv, deferred);
+
     // DBus-activation environment
+    // The bus itself is always there, nothing to defer
     QDBusMessage dbusActivationMsg = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.DBus"),
                                                                     QStringLiteral("/org/freedesktop/DBus"),
                                                                     QStringLiteral("org.freedesktop.DBus"),
                                                                     QStringLiteral("UpdateActivationEnvironment"));
     dbusActivationMsg.setArguments({QVariant::fromValue(dbusActivationEnv)});
 
+    KDBUSADDONS_TRACE(KUpdateLaunchEnvironmentJob_send, dbusActivationMsg.service(), dbusActivationEnv.size());
     auto dbusActivationReply = QDBusConnection::sessionBus().asyncCall(dbusActivationMsg);
-    d->monitorReply(dbusActivationReply);
+    monitorReply(flush, dbusActivationMsg.service(), dbusActivationReply);
 
-    // _user_ systemd env
-    QDBusMessage systemdActivationMsg = QDBusMessage::createMethodCall(QStringLiteral("org.freedesktop.systemd1"),
-                                                                       QStringLiteral("/org/freedesktop/systemd1"),
-                                                                       QStringLiteral("org.freedesktop.systemd1.Manager"),
-                                                                       QStringLiteral("SetEnvironment"));
-    systemdActivationMsg.setArguments({systemdUpdates});
+    sendToSystemd(flush, systemdEnv, systemdUnset, deferred);
+}
 
-    auto systemdActivationReply = QDBusConnection::sessionBus().asyncCall(systemdActivationMsg);
-    d->monitorReply(systemdActivationReply);
-}
-
-bool KUpdateLaunchEnvironmentJobPrivate::isPosixName(const QString &name)
-{
-    // Posix says characters like % should be 'tolerated', but it gives issues in practice.
-    // https://bugzilla.redhat.com/show_bug.cgi?id=1754395
-    // https://bugzilla.redhat.com/show_bug.cgi?id=1879216
-    // Ensure systemd compat by only allowing alphanumerics and _ in names.
-    bool first = true;
-    for (const QChar c : name) {
-        if (first && !c.isLetter() && c != QLatin1Char('_')) {
-            return false;
-        } else if (first) {
-            first = false;
-        } else if (!c.isLetterOrNumber() && c != QLatin1Char('_')) {
-            return false;
+void KLaunchEnvironmentUpdater::sendToPlasmaSession(const std::shared_ptr<Flush> &flush, QMap<QString, QString> environment, QSet<QString> deferred)
+{
+    // Deferred updates go out with the next one, and stay deferred if that fails too,
+    // unless the next one has a new value for them
+    const QMap<QString, QString> leftOver = std::exchange(deferredPlasmaSessionEnvironment, {});
+    for (auto it = leftOver.cbegin(); it != leftOver.cend(); ++it) {
+        if (!environment.contains(it.key())) {
+            environment.insert(it.key(), it.value());
+            deferred.insert(it.key());
         }
     }
-    return !first;
+
+    for (auto it = environment.cbegin(); it != environment.cend(); ++it) {
+        const QString &varName = it.key();
+        const QString &value = it.value();
+
+        QDBusMessage plasmaSessionMsg =
+            QDBusMessage::createMethodCall(s_plasmaSessionService, QStringLiteral("/Startup"), QStringLiteral("org.kde.Startup"), QStringLiteral("updateLaunchEnv"));
+        plasmaSessionMsg.setArguments({QVariant::fromValue(varName), QVariant::fromValue(value)});
+        KDBUSADDONS_TRACE(KUpdateLaunchEnvironmentJob_send, plasmaSessionMsg.service(), 1);
+        auto plasmaSessionReply = QDBusConnection::sessionBus().asyncCall(plasmaSessionMsg);
+        const bool defer = deferred.contains(varName);
+        monitorReply(flush, plasmaSessionMsg.service(), plasmaSessionReply, [this, varName, value, defer](const QDBusError &error) {
+            if (!isTargetAbsent(error)) {
+                return;
+            }
+            // An update that is not deferred supersedes older deferred ones
+            if (defer) {
+                deferredPlasmaSessionEnvironment.insert(varName, value);
+            } else {
+                deferredPlasmaSessionEnvironment.remove(varName);
+            }
+        });
+    }
 }
 
-bool KUpdateLaunchEnvironmentJobPrivate::isSystemdApprovedValue(const QString &value)
+void KLaunchEnvironmentUpdater::sendToSystemd(const std::shared_ptr<Flush> &flush, QMap<QString, QString> environment, QSet<QString> unset, QSet<QString> deferred)
 {
-    // systemd code checks that a value contains no control characters except \n \t
-    // effectively copied from systemd's string_has_cc
-    for (const char &it : value.toLatin1()) {
-        if (it == QLatin1Char('\n') || it == QLatin1Char('\t')) {
-            continue;
+    // As for plasma-session, a new update of a variable replaces the deferred one
+    const QMap<QString, QString> leftOverEnvironment = std::exchange(deferredSystemdEnvironment, {});
+    const QSet<QString> leftOverUnset = std::exchange(deferredSystemdUnset, {});
+    for (auto it = leftOverEnvironment.cbegin(); it != leftOverEnvironment.cend(); ++it) {
+        if (!environment.contains(it.key()) && !unset.contains(it.key())) {
+            environment.insert(it.key(), it.value());
+            deferred.insert(it.key());
+        }
+    }
+    for (const QString &varName : leftOverUnset) {
+        if (!environment.contains(varName) && !unset.contains(varName)) {
+            unset.insert(varName);
+            deferred.insert(varName);
+        }
+    }
+
+    if (environment.isEmpty() && unset.isEmpty()) {
+        return;
+    }
+
+    // Leave out what systemd has already. systemd does not announce changes of its
+    // environment, so it is read right before, others may have changed it since we last did.
+    QDBusMessage environmentMsg = QDBusMessage::createMethodCall(s_systemdService,
+                                                                 QStringLiteral("/org/freedesktop/systemd1"),
+                                                                 QStringLiteral("org.freedesktop.DBus.Properties"),
+                                                                 QStringLiteral("Get"));
+    environmentMsg.setArguments({QStringLiteral("org.freedesktop.systemd1.Manager"), QStringLiteral("Environment")});
+    KDBUSADDONS_TRACE(KUpdateLaunchEnvironmentJob_send, environmentMsg.service(), 0);
+    const QDBusPendingCall environmentReply = QDBusConnection::sessionBus().asyncCall(environmentMsg);
+    monitorReply(flush, s_systemdService, environmentReply, [this, flush, environment, unset, deferred, environmentReply](const QDBusError &error) mutable {
+        // If it cannot be read, the update is sent and fails or succeeds on its own
+        if (!error.isValid()) {
+            const QVariant value = environmentReply.reply().arguments().value(0).value<QDBusVariant>().variant();
+            const QStringList assignments =
+                value.metaType() == QMetaType::fromType<QDBusArgument>() ? qdbus_cast<QStringList>(value.value<QDBusArgument>()) : value.toStringList();
+            // Not announced by systemd, so this is our chance to see what others changed
+            if (auto launchEnvironment = KLaunchEnvironmentPrivate::existingInstance()) {
+                launchEnvironment->setEnvironment(assignments);
+            }
+            QHash<QString, QString> current;
+            for (const QString &assignment : assignments) {
+                const qsizetype separator = assignment.indexOf(QLatin1Char('='));
+                if (separator > 0) {
+                    current.insert(assignment.left(separator), assignment.mid(separator + 1));
+                }
+            }
+            for (auto it = environment.begin(); it != environment.end();) {
+                const auto currentValue = current.constFind(it.key());
+                if (currentValue != current.cend() && *currentValue == it.value()) {
+                    it = environment.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            for (auto it = unset.begin(); it != unset.end();) {
+                if (!current.contains(*it)) {
+                    it = unset.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        setSystemdEnvironment(flush, environment, unset, deferred);
+    });
+}
+
+void KLaunchEnvironmentUpdater::setSystemdEnvironment(const std::shared_ptr<Flush> &flush,
+                                                      const QMap<QString, QString> &environment,
+                                                      const QSet<QString> &unset,
+                                                      const QSet<QString> &deferred)
+{
+    const QStringList systemdUnsets(unset.cbegin(), unset.cend());
+    QStringList systemdUpdates;
+    for (auto it = environment.cbegin(); it != environment.cend(); ++it) {
+        const QString updateString = it.key() + QStringLiteral("=") + it.value();
+        systemdUpdates.append(updateString);
+    }
+
+    if (systemdUpdates.isEmpty() && systemdUnsets.isEmpty()) {
+        return;
+    }
+
+    // Unsetting and setting in one call, so that no unit sees the environment in between
+    QDBusMessage systemdActivationMsg = QDBusMessage::createMethodCall(s_systemdService,
+                                                                       QStringLiteral("/org/freedesktop/systemd1"),
+                                                                       QStringLiteral("org.freedesktop.systemd1.Manager"),
+                                                                       systemdUnsets.isEmpty() ? QStringLiteral("SetEnvironment")
+                                                                                               : QStringLiteral("UnsetAndSetEnvironment"));
+    if (systemdUnsets.isEmpty()) {
+        systemdActivationMsg.setArguments({systemdUpdates});
+    } else {
+        systemdActivationMsg.setArguments({systemdUnsets, systemdUpdates});
+    }
+
+    KDBUSADDONS_TRACE(KUpdateLaunchEnvironmentJob_send, systemdActivationMsg.service(), systemdUpdates.size());
+    auto systemdActivationReply = QDBusConnection::sessionBus().asyncCall(systemdActivationMsg);
+    monitorReply(flush, systemdActivationMsg.service(), systemdActivationReply, [this, environment, systemdUnsets, deferred](const QDBusError &error) {
+        if (!error.isValid()) {
+            if (auto launchEnvironment = KLaunchEnvironmentPrivate::existingInstance()) {
+                launchEnvironment->applyUpdate(environment, systemdUnsets);
+            }
+            return;
         }
-        if (it > 0 && it < ' ') {
-            return false;
+        if (!isTargetAbsent(error)) {
+            return;
         }
-        if (it == 127) {
-            return false;
+        for (const QString &varName : systemdUnsets) {
+            deferredSystemdEnvironment.remove(varName);
+            if (deferred.contains(varName)) {
+                deferredSystemdUnset.insert(varName);
+            } else {
+                deferredSystemdUnset.remove(varName);
+            }
         }
+        for (auto it = environment.cbegin(); it != environment.cend(); ++it) {
+            deferredSystemdUnset.remove(it.key());
+            if (deferred.contains(it.key())) {
+                deferredSystemdEnvironment.insert(it.key(), it.value());
+            } else {
+                deferredSystemdEnvironment.remove(it.key());
+            }
+        }
+    });
+}
+
+void KLaunchEnvironmentUpdater::deliverDeferred(const QString &target)
+{
+    // Nobody waits for these, the jobs finished when the target was found missing
+    auto flush = std::make_shared<Flush>();
+    if (target == s_plasmaSessionService) {
+        sendToPlasmaSession(flush, {}, {});
+    } else if (target == s_systemdService) {
+        sendToSystemd(flush, {}, {}, {});
     }
-    return true;
 }
 
+KUpdateLaunchEnvironmentJob::KUpdateLaunchEnvironmentJob(const QProcessEnvironment &environment)
+    : KUpdateLaunchEnvironmentJob(environment, QStringList())
+{
+}
+
+KUpdateLaunchEnvironmentJob::KUpdateLaunchEnvironmentJob(const QProcessEnvironment &environment, const QStringList &unsetVariables)
+    : d(new KUpdateLaunchEnvironmentJobPrivate)
+{
+    d->environment = environment;
+    d->unsetVariables = unsetVariables;
+    QTimer::singleShot(0, this, &KUpdateLaunchEnvironmentJob::start);
+}
+
+KUpdateLaunchEnvironmentJob::~KUpdateLaunchEnvironmentJob() = default;
+
+void KUpdateLaunchEnvironmentJob::setDeferredDelivery(bool deferred)
+{
+    d->deferredDelivery = deferred;
+}
+
+bool KUpdateLaunchEnvironmentJob::deferredDelivery() const
+{
+    return d->deferredDelivery;
+}
+
+void KUpdateLaunchEnvironmentJob::start()
+{
+    // Jobs created at about the same time are sent together
+    KLaunchEnvironmentUpdater::instance()->update(d->environment, d->unsetVariables, d->deferredDelivery, this, [this]() {
+        Q_EMIT finished();
+        deleteLater();
+    });
+}
+
+#include "kupdatelaunchenvironmentjob.moc"
 #include "moc_kupdatelaunchenvironmentjob.cpp"
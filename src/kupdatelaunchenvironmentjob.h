@@ -11,6 +11,7 @@
 #include <kdbusaddons_export.h>
 
 #include <QProcessEnvironment>
+#include <QStringList>
 
 #include <memory>
 
@@ -31,12 +32,20 @@ class KUpdateLaunchEnvironmentJobPrivate;
  *
  * Environment variables are sanitized before uploading.
  *
+ * Since 6.12, jobs started within a few milliseconds of each other in the same
+ * process are merged into one update of each target, where the value from the
+ * job created last wins for a variable set by several jobs. Each job finishes
+ * once the update containing its variables has completed. The environment of
+ * the systemd user manager is read right before updating it, and variables it
+ * already has with the same value are not sent to it again.
+ *
  * This object deletes itself after completion, similar to KJobs
  *
  * Porting from KF5 to KF6:
  *
  * The class UpdateLaunchEnvironmentJob was renamed to KUpdateLaunchEnvironmentJob.
  *
+ * @see KLaunchEnvironment
  * @since 6.0
  */
 class KDBUSADDONS_EXPORT KUpdateLaunchEnvironmentJob : public QObject
@@ -45,8 +54,49 @@ class KDBUSADDONS_EXPORT KUpdateLaunchEnvironmentJob : public QObject
 
 public:
     explicit KUpdateLaunchEnvironmentJob(const QProcessEnvironment &environment);
+
+    /**
+     * Sets the variables of @p environment and unsets @p unsetVariables.
+     *
+     * The systemd user manager gets both in a single @c UnsetAndSetEnvironment
+     * call, so units never see a state in between. Neither the D-Bus activation
+     * environment nor plasma-session support unsetting variables, they keep the
+     * values of unset variables.
+     *
+     * A variable both set and unset is set.
+     *
+     * @since 6.12
+     */
+    KUpdateLaunchEnvironmentJob(const QProcessEnvironment &environment, const QStringList &unsetVariables);
     ~KUpdateLaunchEnvironmentJob() override;
 
+    /**
+     * Sets whether the update is kept for targets that are not on the bus yet.
+     *
+     * Early in the session, plasma-session or the systemd user manager may not
+     * have taken their bus names yet. By default, the update is lost for them.
+     * With deferred delivery, it is kept instead and sent once the target
+     * registers, together with anything deferred before. Values set later by
+     * other jobs still win. Only the variables of this job are kept, not those
+     * of jobs without deferred delivery merged into the same update.
+     *
+     * The job finishes once the targets on the bus have replied, without waiting
+     * for the deferred delivery.
+     *
+     * This must be set before returning to the event loop, when the job starts.
+     *
+     * @since 6.12
+     */
+    void setDeferredDelivery(bool deferred);
+
+    /**
+     * Returns whether updates are kept for targets that are not on the bus yet.
+     *
+     * @see setDeferredDelivery()
+     * @since 6.12
+     */
+    bool deferredDelivery() const;
+
 Q_SIGNALS:
     void finished();
 
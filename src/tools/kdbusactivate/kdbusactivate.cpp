@@ -0,0 +1,237 @@
+/*
+    SPDX-FileCopyrightText: 2026 KDE Contributors
+
+    SPDX-License-Identifier: LGPL-2.1-only OR LGPL-3.0-only OR LicenseRef-KDE-Accepted-LGPL
+*/
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDBusConnection>
+#include <QDBusConnectionInterface>
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QRegularExpression>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+// Nearest-rank percentile of the sorted @p latencies
+static qint64 percentile(const QList<qint64> &latencies, double fraction)
+{
+    const qsizetype rank = qsizetype(std::ceil(fraction * latencies.size()));
+    return latencies.at(std::clamp<qsizetype>(rank - 1, 0, latencies.size() - 1));
+}
+
+static QString formatLatency(qint64 nsecs)
+{
+    return QCoreApplication::translate("main", "%1 ms").arg(nsecs / 1e6, 0, 'f', 3);
+}
+
+// Where KDBusService registers its object: the path is built from the name
+// before the suffixes of Multiple instances and of shards are appended to it.
+// The instance suffix is only removed if it names the owner of @p service,
+// so that names like org.kde.app-2 are left alone.
+static QString objectPathForService(QString service, QDBusConnectionInterface *bus)
+{
+    const QString pidSuffix = QLatin1Char('-') + QString::number(bus->servicePid(service).value());
+    static const QRegularExpression uniqueNameSeparators(QStringLiteral("[\\.:]"));
+    const QString uniqueNameSuffix = QStringLiteral(".kdbus-") + bus->serviceOwner(service).value().replace(uniqueNameSeparators, QStringLiteral("_"));
+    if (service.endsWith(pidSuffix)) {
+        service.chop(pidSuffix.size());
+    } else if (service.endsWith(uniqueNameSuffix)) {
+        service.chop(uniqueNameSuffix.size());
+    }
+
+    static const QRegularExpression shardSuffix(QStringLiteral("\\.shard_[0-9a-f]{16}$"));
+    service.remove(shardSuffix);
+
+    QString path = QLatin1Char('/') + service;
+    path.replace(QLatin1Char('.'), QLatin1Char('/'));
+    path.replace(QLatin1Char('-'), QLatin1Char('_'));
+    return path;
+}
+
+static int readCount(const QCommandLineParser &parser, const QString &option, int minimum)
+{
+    bool ok = false;
+    const int value = parser.value(option).toInt(&ok);
+    if (!ok || value < minimum) {
+        qWarning() << QCoreApplication::translate("main", "Invalid value %1 for --%2.").arg(parser.value(option), option);
+        return -1;
+    }
+    return value;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName(QStringLiteral("kdbusactivate"));
+    app.setApplicationVersion(QStringLiteral("1.0"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        QCoreApplication::translate("main", "Send activation requests to a running D-Bus enabled application and measure how fast they are handled"));
+    parser.addOption(QCommandLineOption(QStringLiteral("service"),
+                                        QCoreApplication::translate("main", "Full service name, overrides application name provided"),
+                                        QStringLiteral("service")));
+    parser.addOption(QCommandLineOption(QStringLiteral("path"),
+                                        QCoreApplication::translate("main", "Path in the D-Bus interface to use, derived from the service name by default"),
+                                        QStringLiteral("path")));
+    parser.addOption(QCommandLineOption(QStringLiteral("method"),
+                                        QCoreApplication::translate("main", "The request to send: activate, open, action or commandline"),
+                                        QStringLiteral("method"),
+                                        QStringLiteral("activate")));
+    parser.addOption(QCommandLineOption(QStringLiteral("action"),
+                                        QCoreApplication::translate("main", "Name of the action to activate with --method action"),
+                                        QStringLiteral("action")));
+    parser.addOption(QCommandLineOption(QStringLiteral("uri"),
+                                        QCoreApplication::translate("main", "URI to open with --method open, can be given several times"),
+                                        QStringLiteral("uri")));
+    parser.addOption(QCommandLineOption(QStringLiteral("argument"),
+                                        QCoreApplication::translate("main", "Argument to pass with --method commandline, can be given several times"),
+                                        QStringLiteral("argument")));
+    parser.addOption(QCommandLineOption(QStringLiteral("count"),
+                                        QCoreApplication::translate("main", "Number of requests to send"),
+                                        QStringLiteral("count"),
+                                        QStringLiteral("100")));
+    parser.addOption(QCommandLineOption(QStringLiteral("concurrency"),
+                                        QCoreApplication::translate("main", "Number of requests waiting for their reply at the same time"),
+                                        QStringLiteral("concurrency"),
+                                        QStringLiteral("1")));
+    parser.addOption(QCommandLineOption(QStringLiteral("payload-size"),
+                                        QCoreApplication::translate("main", "Number of bytes of padding added to the platform data of each request"),
+                                        QStringLiteral("bytes"),
+                                        QStringLiteral("0")));
+    parser.addPositionalArgument(QStringLiteral("[application]"), QCoreApplication::translate("main", "The name of the application to activate"));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.process(app);
+
+    const QString method = parser.value(QStringLiteral("method")).toLower();
+    if (method == QLatin1String("action") && !parser.isSet(QStringLiteral("action"))) {
+        qWarning() << QCoreApplication::translate("main", "--method action needs the name of the action, given with --action.");
+        return 1;
+    }
+
+    QString service;
+    if (parser.isSet(QStringLiteral("service"))) {
+        service = parser.value(QStringLiteral("service"));
+    } else if (!parser.positionalArguments().isEmpty()) {
+        service = QStringLiteral("org.kde.%1").arg(parser.positionalArguments().at(0));
+    } else {
+        parser.showHelp(1);
+    }
+
+    const int count = readCount(parser, QStringLiteral("count"), 1);
+    const int concurrency = readCount(parser, QStringLiteral("concurrency"), 1);
+    const int payloadSize = readCount(parser, QStringLiteral("payload-size"), 0);
+    if (count < 0 || concurrency < 0 || payloadSize < 0) {
+        return 1;
+    }
+
+    // Unknown platform data is ignored by the application
+    QVariantMap platformData;
+    if (payloadSize > 0) {
+        platformData.insert(QStringLiteral("kdbusactivate-padding"), QString(payloadSize, QLatin1Char('x')));
+    }
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.interface()->isServiceRegistered(service)) {
+        qWarning() << QCoreApplication::translate("main", "Application could not be found using service %1.").arg(service);
+        return 1;
+    }
+
+    QString path = parser.value(QStringLiteral("path"));
+    if (path.isEmpty()) {
+        path = objectPathForService(service, bus.interface());
+    }
+
+    QDBusMessage message;
+    if (method == QLatin1String("activate")) {
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.freedesktop.Application"), QStringLiteral("Activate"));
+        message.setArguments({platformData});
+    } else if (method == QLatin1String("open")) {
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.freedesktop.Application"), QStringLiteral("Open"));
+        message.setArguments({parser.values(QStringLiteral("uri")), platformData});
+    } else if (method == QLatin1String("action")) {
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.freedesktop.Application"), QStringLiteral("ActivateAction"));
+        message.setArguments({parser.value(QStringLiteral("action")), QVariantList(), platformData});
+    } else if (method == QLatin1String("commandline")) {
+        const QStringList arguments = QStringList{QCoreApplication::applicationFilePath()} + parser.values(QStringLiteral("argument"));
+        message = QDBusMessage::createMethodCall(service, path, QStringLiteral("org.kde.KDBusService"), QStringLiteral("CommandLine"));
+        message.setArguments({arguments, QDir::currentPath(), platformData});
+    } else {
+        qWarning() << QCoreApplication::translate("main", "Unknown method %1.").arg(method);
+        return 1;
+    }
+
+    int sent = 0;
+    int finished = 0;
+    int errors = 0;
+    QDBusError firstError;
+    QList<qint64> latencies;
+    latencies.reserve(count);
+
+    // Each reply makes room for the next request
+    std::function<void()> sendNext;
+    sendNext = [&]() {
+        ++sent;
+        QElapsedTimer timer;
+        timer.start();
+        auto *watcher = new QDBusPendingCallWatcher(bus.asyncCall(message), &app);
+        QObject::connect(watcher, &QDBusPendingCallWatcher::finished, &app, [&, timer](QDBusPendingCallWatcher *watcher) {
+            const qint64 latency = timer.nsecsElapsed();
+            if (watcher->isError()) {
+                if (errors++ == 0) {
+                    firstError = watcher->error();
+                }
+            } else {
+                latencies.append(latency);
+            }
+            watcher->deleteLater();
+
+            ++finished;
+            if (sent < count) {
+                sendNext();
+            } else if (finished == count) {
+                app.quit();
+            }
+        });
+    };
+
+    QElapsedTimer total;
+    total.start();
+    for (int i = 0; i < std::min(concurrency, count); ++i) {
+        sendNext();
+    }
+    app.exec();
+    const qint64 elapsed = total.nsecsElapsed();
+
+    QTextStream out(stdout);
+    out << QCoreApplication::translate("main", "%1 %2 requests to %3, %4 at a time").arg(count).arg(message.member(), service).arg(concurrency) << '\n';
+    out << QCoreApplication::translate("main", "Time:       %1 s").arg(elapsed / 1e9, 0, 'f', 3) << '\n';
+    out << QCoreApplication::translate("main", "Throughput: %1 requests/s").arg(count / (elapsed / 1e9), 0, 'f', 1) << '\n';
+    out << QCoreApplication::translate("main", "Failed:     %1").arg(errors) << '\n';
+
+    if (!latencies.isEmpty()) {
+        std::sort(latencies.begin(), latencies.end());
+        out << QCoreApplication::translate("main", "Latency:    p50 %1, p90 %2, p99 %3, max %4")
+                   .arg(formatLatency(percentile(latencies, 0.5)),
+                        formatLatency(percentile(latencies, 0.9)),
+                        formatLatency(percentile(latencies, 0.99)),
+                        formatLatency(latencies.last()))
+            << '\n';
+    }
+    out.flush();
+
+    if (errors > 0) {
+        qWarning() << QCoreApplication::translate("main", "%1 requests failed, the first with:\n\n     %2 : %3").arg(errors).arg(firstError.name(), firstError.message());
+        return 1;
+    }
+    return 0;
+}